@@ -0,0 +1,283 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+/**
+ * Micro-benchmarks for ICTSync. Build with "make DEBUG=-O2 bench" and run
+ * $(OBJDIR)/ict-bench <test>, where test is one of:
+ *   diff  ICTVectorState::getDiff (parse and diff) and diffSortedStates
+ *         alone on 1k, 10k and 100k entry states, with each diff kernel
+ *         supported by the CPU
+ *   sign  packets per second signing a sync Data with each SigningMode
+ *   state bytes on the wire, time to update one entry and re-encode, and
+ *         time to parse, for each StateEncoding on 100, 1k and 10k entry
+ *         states, and the size of the newcomer Data content with and
+ *         without gzip
+ *   codec encode and decode time of sync Data content with 20, 1k and 10k
+ *         entries, as a protobuf message parsed with ParseFromArray, and in
+ *         each ContentFormat read through a SyncContentView
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <tuple>
+#include "ict-vector-state.hpp"
+#include "ict-diff-kernel.hpp"
+#include "signing-strategy.hpp"
+#include "sync-content.hpp"
+#include "sync-state.pb.h"
+
+using namespace std;
+using namespace ict;
+using namespace ndn;
+
+namespace {
+
+const char* const KERNEL_NAMES[] = { "scalar", "sse2", "avx2" };
+
+/**
+ * Run f repeatedly for about minSeconds and return the mean time of one call
+ * in nanoseconds.
+ */
+template<typename F>
+double
+timeCall(const F& f, double minSeconds = 0.2)
+{
+  typedef std::chrono::steady_clock Clock;
+  size_t calls = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  do {
+    for (int i = 0; i < 16; ++i)
+      f();
+    calls += 16;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < minSeconds);
+  return elapsed * 1e9 / calls;
+}
+
+int
+benchDiff()
+{
+  printf("%-8s %-10s %-7s %12s %14s %12s %14s\n", "entries", "remote", "kernel",
+         "getDiff ns", "Mentries/s", "kernel ns", "Mentries/s");
+  for (size_t size : {1000, 10000, 100000}) {
+    ICTVectorState local;
+    for (size_t i = 0; i < size; ++i)
+      local.update("/ict/bench/node" + to_string(i), 1000 + i * 7, 50 + i % 100);
+
+    // A converged peer sends our own root. A peer which is behind on 1% of
+    // the sessions sends older sequence numbers for them.
+    vector<uint32_t> sessions, sequences, behindSequences;
+    string converged = local.getVectorRoot();
+    string behind;
+    for (size_t i = 0; i < size; ++i) {
+      ICTVectorState::Node node = local.get(i);
+      int seq = node.getSequenceNo() - (i % 100 == 0 ? 1 : 0);
+      behind.append(to_string(node.getSessionNo())).append(",")
+        .append(to_string(seq)).append(";");
+      sessions.push_back(node.getSessionNo());
+      sequences.push_back(node.getSequenceNo());
+      behindSequences.push_back(seq);
+    }
+
+    for (const auto& remote : {make_tuple("converged", &converged, &sequences),
+                               make_tuple("1%-behind", &behind, &behindSequences)}) {
+      for (int kernel = DIFF_KERNEL_SCALAR; kernel <= DIFF_KERNEL_AVX2; ++kernel) {
+        if (!setDiffKernel((DiffKernel)kernel))
+          continue;
+
+        const string& state = *get<1>(remote);
+        vector<uint32_t> positive;
+        vector<tuple<uint32_t, uint32_t>> negative, unknown;
+        bool pushLocalSessions;
+        double ns = timeCall([&] {
+            local.getDiff((const uint8_t*)state.data(), state.size(), STATE_ENCODING_TEXT,
+                          positive, negative, unknown, pushLocalSessions);
+          });
+
+        const vector<uint32_t>& remoteSequences = *get<2>(remote);
+        double kernelNs = timeCall([&] {
+            diffSortedStates(sessions.data(), sequences.data(), size,
+                             sessions.data(), remoteSequences.data(), size,
+                             positive, negative, unknown);
+          });
+        printf("%-8zu %-10s %-7s %12.0f %14.2f %12.0f %14.2f\n", size, get<0>(remote),
+               KERNEL_NAMES[kernel], ns, size * 1e3 / ns, kernelNs, size * 1e3 / kernelNs);
+      }
+    }
+  }
+  return 0;
+}
+
+int
+benchSign()
+{
+  // in-memory, so that the benchmark does not touch the user's keys
+  KeyChain keyChain("pib-memory:", "tpm-memory:");
+  security::Identity identity = keyChain.createIdentity(Name("/ict/bench"));
+  SigningStrategy strategy(identity.getDefaultKey().getDefaultCertificate().getName());
+  strategy.setHmacKey("aWN0LWJlbmNoLWdyb3VwLWtleS0wMTIzNDU2Nzg5YWI=");
+
+  // about the size of a sync Data with 20 entries
+  vector<uint8_t> content(200, 0x5a);
+  Data data(Name("/ict/bench/sync").append("1000,50;1007,51;"));
+  data.setContent(content.data(), content.size());
+
+  printf("%-12s %12s %12s\n", "mode", "ns/packet", "packets/s");
+  for (SigningMode mode : {SIGNING_CERTIFICATE, SIGNING_DIGEST_SHA256, SIGNING_HMAC}) {
+    strategy.setMode(SYNC_DATA_SYNC, mode);
+    double ns = timeCall([&] { strategy.sign(keyChain, data, SYNC_DATA_SYNC); });
+    printf("%-12s %12.0f %12.0f\n", SigningStrategy::getModeName(mode), ns, 1e9 / ns);
+  }
+  return 0;
+}
+
+int
+benchState()
+{
+  const char* const ENCODING_NAMES[] = { "text", "binary", "compressed" };
+
+  printf("%-8s %-11s %10s %12s %12s\n", "entries", "encoding", "bytes",
+         "update ns", "parse ns");
+  for (size_t size : {100, 1000, 10000}) {
+    // sessions are start times in seconds, so spread over a few days
+    mt19937 random(size);
+    ICTVectorState local;
+    Sync::SyncStateMsg newcomer;
+    for (size_t i = 0; i < size; ++i) {
+      string prefix = "/ict/bench/node" + to_string(i);
+      int session = 1600000000 + (int)(random() % 300000);
+      int seq = 1 + (int)(random() % 5000);
+      local.update(prefix, session, seq);
+      Sync::SyncState* entry = newcomer.add_ss();
+      entry->set_name(prefix);
+      entry->set_type(Sync::SyncState_ActionType_UPDATE);
+      entry->mutable_seqno()->set_seq(seq);
+      entry->mutable_seqno()->set_session(session);
+    }
+
+    for (int encoding = STATE_ENCODING_TEXT; encoding <= STATE_ENCODING_COMPRESSED; ++encoding) {
+      auto getState = [&] () -> const string& {
+        if (encoding == STATE_ENCODING_BINARY)
+          return local.getBinaryState();
+        if (encoding == STATE_ENCODING_COMPRESSED)
+          return local.getCompressedState();
+        return local.getVectorRoot();
+      };
+
+      // publish on one node, then encode the new state
+      ICTVectorState::Node node = local.get(size / 2);
+      string prefix = node.getDataPrefix();
+      int session = node.getSessionNo();
+      int seq = node.getSequenceNo();
+      double updateNs = timeCall([&] {
+          local.update(prefix, session, ++seq);
+          getState();
+        });
+
+      const string& state = getState();
+      ICTVectorState::RemoteState remote;
+      double parseNs = timeCall([&] {
+          ICTVectorState::parseState((const uint8_t*)state.data(), state.size(),
+                                     (StateEncoding)encoding, remote);
+        });
+      printf("%-8zu %-11s %10zu %12.0f %12.0f\n", size, ENCODING_NAMES[encoding],
+             state.size(), updateNs, parseNs);
+    }
+
+    string content;
+    newcomer.SerializeToString(&content);
+    printf("%-8zu %-11s %10zu\n", size, "newcomer", content.size());
+    printf("%-8zu %-11s %10zu\n", size, "newcomer-gz", Gzip::compress(content).size());
+  }
+  return 0;
+}
+
+int
+benchCodec()
+{
+  printf("%-8s %-16s %10s %12s %12s\n", "entries", "decoder", "bytes", "encode ns",
+         "decode ns");
+  for (size_t size : {20, 1000, 10000}) {
+    vector<string> names;
+    for (size_t i = 0; i < size; ++i)
+      names.push_back("/ict/bench/node" + to_string(i));
+
+    for (ContentFormat format : {CONTENT_FORMAT_PROTOBUF, CONTENT_FORMAT_TLV}) {
+      ConstBufferPtr content;
+      double encodeNs = timeCall([&] {
+          SyncContentEncoder encoder(format);
+          for (size_t i = 0; i < size; ++i)
+            encoder.add(names[i], SYNC_ACTION_UPDATE, 1600000000 + i * 7, 50 + i % 100);
+          content = encoder.encode();
+        });
+
+      // sum the fields so that the decoding is not optimized away
+      uint64_t sum = 0;
+      if (format == CONTENT_FORMAT_PROTOBUF) {
+        double decodeNs = timeCall([&] {
+            Sync::SyncStateMsg message;
+            message.ParseFromArray(content->data(), content->size());
+            for (int i = 0; i < message.ss_size(); ++i)
+              sum += message.ss(i).seqno().session() + message.ss(i).seqno().seq() +
+                message.ss(i).name().size();
+          });
+        printf("%-8zu %-16s %10zu %12.0f %12.0f\n", size, "protobuf", content->size(),
+               encodeNs, decodeNs);
+      }
+
+      double viewNs = timeCall([&] {
+          SyncContentView view;
+          view.parse(content);
+          for (const SyncContentView::Entry& entry : view)
+            sum += entry.getSession() + entry.getSequence() + entry.hasName();
+        });
+      printf("%-8zu %-16s %10zu %12.0f %12.0f\n", size,
+             format == CONTENT_FORMAT_TLV ? "tlv-view" : "protobuf-view", content->size(),
+             encodeNs, viewNs);
+      if (sum == 0)
+        printf("\n");
+    }
+  }
+  return 0;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc >= 2 && strcmp(argv[1], "diff") == 0)
+    return benchDiff();
+  if (argc >= 2 && strcmp(argv[1], "sign") == 0)
+    return benchSign();
+  if (argc >= 2 && strcmp(argv[1], "state") == 0)
+    return benchState();
+  if (argc >= 2 && strcmp(argv[1], "codec") == 0)
+    return benchCodec();
+
+  fprintf(stderr, "Usage: %s diff|sign|state|codec\n", argv[0]);
+  return 1;
+}
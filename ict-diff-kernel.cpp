@@ -0,0 +1,277 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#include "ict-diff-kernel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ICT_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define ICT_HAVE_X86_SIMD 0
+#endif
+
+using namespace std;
+
+namespace ict {
+
+namespace {
+
+typedef std::vector<std::tuple<uint32_t, uint32_t>> EntryList;
+
+struct DiffInput {
+  const uint32_t* localSessions;
+  const uint32_t* localSequences;
+  size_t localSize;
+  const uint32_t* remoteSessions;
+  const uint32_t* remoteSequences;
+  size_t remoteSize;
+};
+
+// Compare local node i with remote entry j, which have the same session.
+inline void
+compareEntry(const DiffInput& in, size_t i, size_t j,
+             std::vector<uint32_t>& positive, EntryList& negative)
+{
+  if (in.localSequences[i] > in.remoteSequences[j])
+    positive.push_back(i);
+  else if (in.localSequences[i] < in.remoteSequences[j])
+    negative.push_back(std::make_tuple(in.remoteSessions[j], in.remoteSequences[j]));
+}
+
+// Emit the entries of a block whose sessions all match. Bit k of newer (resp.
+// older) is set if local node i + k has a newer (resp. older) sequence than
+// remote entry j + k.
+inline void
+emitBlock(const DiffInput& in, size_t i, size_t j, unsigned newer, unsigned older,
+          std::vector<uint32_t>& positive, EntryList& negative)
+{
+  for (size_t k = 0; (newer | older) != 0; ++k, newer >>= 1, older >>= 1) {
+    if (newer & 1)
+      positive.push_back(i + k);
+    else if (older & 1)
+      negative.push_back(std::make_tuple(in.remoteSessions[j + k], in.remoteSequences[j + k]));
+  }
+}
+
+// A Blocks type provides matchBlocks, which consumes whole blocks starting at
+// local node i and remote entry j for as long as their sessions are equal
+// position by position, which is the common case between two converged
+// states. It advances i and j past the blocks it consumed.
+
+struct ScalarBlocks {
+  static void
+  matchBlocks(const DiffInput& in, size_t& i, size_t& j,
+              std::vector<uint32_t>& positive, EntryList& negative)
+  {
+  }
+};
+
+#if ICT_HAVE_X86_SIMD
+struct Sse2Blocks {
+  __attribute__((target("sse2"))) static void
+  matchBlocks(const DiffInput& in, size_t& i, size_t& j,
+              std::vector<uint32_t>& positive, EntryList& negative)
+  {
+    // flip the sign bit so the signed compare orders the sequences as unsigned
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    while (i + 4 <= in.localSize && j + 4 <= in.remoteSize) {
+      __m128i ls = _mm_loadu_si128((const __m128i*)(in.localSessions + i));
+      __m128i rs = _mm_loadu_si128((const __m128i*)(in.remoteSessions + j));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(ls, rs)) != 0xFFFF)
+        break;
+
+      __m128i lq = _mm_loadu_si128((const __m128i*)(in.localSequences + i));
+      __m128i rq = _mm_loadu_si128((const __m128i*)(in.remoteSequences + j));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(lq, rq)) != 0xFFFF) {
+        lq = _mm_xor_si128(lq, bias);
+        rq = _mm_xor_si128(rq, bias);
+        unsigned newer = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lq, rq)));
+        unsigned older = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(rq, lq)));
+        emitBlock(in, i, j, newer, older, positive, negative);
+      }
+      i += 4;
+      j += 4;
+    }
+  }
+};
+
+struct Avx2Blocks {
+  __attribute__((target("avx2"))) static void
+  matchBlocks(const DiffInput& in, size_t& i, size_t& j,
+              std::vector<uint32_t>& positive, EntryList& negative)
+  {
+    // flip the sign bit so the signed compare orders the sequences as unsigned
+    const __m256i bias = _mm256_set1_epi32((int)0x80000000);
+    while (i + 8 <= in.localSize && j + 8 <= in.remoteSize) {
+      __m256i ls = _mm256_loadu_si256((const __m256i*)(in.localSessions + i));
+      __m256i rs = _mm256_loadu_si256((const __m256i*)(in.remoteSessions + j));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(ls, rs)) != -1)
+        break;
+
+      __m256i lq = _mm256_loadu_si256((const __m256i*)(in.localSequences + i));
+      __m256i rq = _mm256_loadu_si256((const __m256i*)(in.remoteSequences + j));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(lq, rq)) != -1) {
+        lq = _mm256_xor_si256(lq, bias);
+        rq = _mm256_xor_si256(rq, bias);
+        unsigned newer = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lq, rq)));
+        unsigned older = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(rq, lq)));
+        emitBlock(in, i, j, newer, older, positive, negative);
+      }
+      i += 8;
+      j += 8;
+    }
+  }
+};
+#endif
+
+template<typename Blocks>
+bool
+mergeDiff(const DiffInput& in, std::vector<uint32_t>& positive,
+          EntryList& negative, EntryList& unknown)
+{
+  bool pushLocalSessions = false;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < in.localSize && j < in.remoteSize) {
+    if (in.localSessions[i] == in.remoteSessions[j]) {
+      Blocks::matchBlocks(in, i, j, positive, negative);
+      if (i >= in.localSize || j >= in.remoteSize)
+        break;
+    }
+
+    uint32_t localSession = in.localSessions[i];
+    uint32_t remoteSession = in.remoteSessions[j];
+    if (j > 0 && localSession == in.remoteSessions[j - 1]) {
+      // another local node with the session of the previous remote entry
+      compareEntry(in, i, j - 1, positive, negative);
+      ++i;
+    }
+    else if (localSession < remoteSession) {
+      // local was not found in remote
+      pushLocalSessions = true;
+      positive.push_back(i);
+      ++i;
+    }
+    else if (localSession > remoteSession) {
+      // remote session id not found in local
+      unknown.push_back(std::make_tuple(remoteSession, in.remoteSequences[j]));
+      ++j;
+    }
+    else {
+      compareEntry(in, i, j, positive, negative);
+      ++i;
+      ++j;
+    }
+  }
+
+  for (; i < in.localSize; ++i) {
+    if (j > 0 && in.localSessions[i] == in.remoteSessions[j - 1])
+      compareEntry(in, i, j - 1, positive, negative);
+    else {
+      pushLocalSessions = true;
+      positive.push_back(i);
+    }
+  }
+  for (; j < in.remoteSize; ++j)
+    unknown.push_back(std::make_tuple(in.remoteSessions[j], in.remoteSequences[j]));
+
+  return pushLocalSessions;
+}
+
+DiffKernel
+selectDiffKernel()
+{
+  if (isDiffKernelSupported(DIFF_KERNEL_AVX2))
+    return DIFF_KERNEL_AVX2;
+  if (isDiffKernelSupported(DIFF_KERNEL_SSE2))
+    return DIFF_KERNEL_SSE2;
+  return DIFF_KERNEL_SCALAR;
+}
+
+DiffKernel&
+currentDiffKernel()
+{
+  static DiffKernel kernel = selectDiffKernel();
+  return kernel;
+}
+
+} // namespace
+
+bool
+diffSortedStates(const uint32_t* localSessions, const uint32_t* localSequences,
+                 size_t localSize,
+                 const uint32_t* remoteSessions, const uint32_t* remoteSequences,
+                 size_t remoteSize,
+                 std::vector<uint32_t>& positiveLocalIndexes,
+                 std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                 std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions)
+{
+  positiveLocalIndexes.clear();
+  negativeInLocal.clear();
+  unknownSessions.clear();
+
+  DiffInput in = {localSessions, localSequences, localSize,
+                  remoteSessions, remoteSequences, remoteSize};
+  switch (currentDiffKernel()) {
+#if ICT_HAVE_X86_SIMD
+  case DIFF_KERNEL_AVX2:
+    return mergeDiff<Avx2Blocks>(in, positiveLocalIndexes, negativeInLocal, unknownSessions);
+  case DIFF_KERNEL_SSE2:
+    return mergeDiff<Sse2Blocks>(in, positiveLocalIndexes, negativeInLocal, unknownSessions);
+#endif
+  default:
+    return mergeDiff<ScalarBlocks>(in, positiveLocalIndexes, negativeInLocal, unknownSessions);
+  }
+}
+
+DiffKernel
+getDiffKernel()
+{
+  return currentDiffKernel();
+}
+
+bool
+isDiffKernelSupported(DiffKernel kernel)
+{
+  switch (kernel) {
+  case DIFF_KERNEL_SCALAR:
+    return true;
+#if ICT_HAVE_X86_SIMD
+  case DIFF_KERNEL_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case DIFF_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+bool
+setDiffKernel(DiffKernel kernel)
+{
+  if (!isDiffKernelSupported(kernel))
+    return false;
+  currentDiffKernel() = kernel;
+  return true;
+}
+
+}
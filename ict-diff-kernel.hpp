@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_DIFF_KERNEL_HPP
+#define NDN_ICT_DIFF_KERNEL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tuple>
+#include <vector>
+
+namespace ict {
+
+/**
+ * The implementations of diffSortedStates. The best one supported by the CPU
+ * is selected at runtime.
+ */
+enum DiffKernel {
+  DIFF_KERNEL_SCALAR = 0,
+  // 4 entries per step, SSE2 (always available on x86-64)
+  DIFF_KERNEL_SSE2 = 1,
+  // 8 entries per step
+  DIFF_KERNEL_AVX2 = 2
+};
+
+/**
+ * Find the set-difference between two states in one merged pass. Both are
+ * given as parallel arrays of session ids and sequence numbers, sorted by
+ * session id. The remote sessions must be strictly increasing; the local
+ * ones may repeat (the same session under two data prefixes).
+ * Runs of entries with the same sessions are compared a SIMD block at a time.
+ * The output is the same as ICTVectorState::getDiff: the outputs are cleared
+ * and then filled in local (resp. remote) order.
+ * @param positiveLocalIndexes Local indexes which are newer than remote or
+ * not in remote.
+ * @param negativeInLocal Remote (session, seq) entries newer than local.
+ * @param unknownSessions Remote (session, seq) entries not in local.
+ * @return True if a local session was not found in remote.
+ */
+bool
+diffSortedStates(const uint32_t* localSessions, const uint32_t* localSequences,
+                 size_t localSize,
+                 const uint32_t* remoteSessions, const uint32_t* remoteSequences,
+                 size_t remoteSize,
+                 std::vector<uint32_t>& positiveLocalIndexes,
+                 std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                 std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions);
+
+/**
+ * Get the kernel used by diffSortedStates.
+ */
+DiffKernel
+getDiffKernel();
+
+/**
+ * Check if the CPU supports the given kernel.
+ */
+bool
+isDiffKernelSupported(DiffKernel kernel);
+
+/**
+ * Force diffSortedStates to use the given kernel, for benchmarks.
+ * @return False (and leave the kernel unchanged) if it is not supported.
+ */
+bool
+setDiffKernel(DiffKernel kernel);
+
+}
+
+#endif
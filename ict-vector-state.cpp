@@ -31,9 +31,7 @@
 //#include "../../contrib/openssl/sha.h"
 //#endif
 #include "ict-vector-state.hpp"
-#include <boost/fusion/adapted/std_tuple.hpp>
-#include <boost/fusion/include/adapt_struct.hpp>
-#include <boost/spirit/include/qi.hpp>
+#include "ict-diff-kernel.hpp"
 #include <tuple>
 
 
@@ -66,54 +64,189 @@ ICTVectorState::update(const std::string& dataPrefix, int sessionNo, int sequenc
   NDN_LOG_DEBUG("ICTVectorState::update session " << sessionNo << ", index " << index);
   if (index >= 0) {
     // only update the newer status
-    if (digestNode_[index]->getSequenceNo() < sequenceNo)
-      digestNode_[index]->setSequenceNo(sequenceNo);
+    if (sequences_[index] < sequenceNo) {
+      fingerprint_ -= getEntryFingerprint(sessionNo, sequences_[index]);
+      sequences_[index] = sequenceNo;
+      fingerprint_ += getEntryFingerprint(sessionNo, sequenceNo);
+      replaceEntry(vectorRoot_, rootOffsets_, rootPositions_[index],
+                   makeUserDigest(sessionNo, sequenceNo));
+      replaceEntry(binaryRoot_, binaryOffsets_, index,
+                   encodeBinaryEntry(sessionNo, sequenceNo));
+      logChange(index);
+    }
     else
       return false;
   }
   else {
     NDN_LOG_DEBUG("new comer " << dataPrefix << ", session " << sessionNo <<
                ", sequence " << sequenceNo);
-    // Insert into digestnode_ sorted.
-    std::shared_ptr<Node> temp(new Node(dataPrefix, sessionNo, sequenceNo));
-    digestNode_.insert
-      (std::lower_bound(digestNode_.begin(), digestNode_.end(), temp, nodeCompare_),
-       temp);
+    // Insert sorted by session and then data prefix. Nodes normally arrive
+    // in session order (e.g. from a newcomer reply), so pos is usually the
+    // end and nothing has to move.
+    size_t rootPos = findRootPosition(dataPrefix, sessionNo);
+    size_t pos = std::lower_bound(sessions_.begin(), sessions_.end(), sessionNo,
+                                  [] (int32_t a, int32_t b) {
+                                    return (uint32_t)a < (uint32_t)b;
+                                  }) - sessions_.begin();
+    while (pos < sessions_.size() && sessions_[pos] == sessionNo &&
+           prefixArena_.compare(prefixOffsets_[pos], prefixLengths_[pos], dataPrefix) < 0)
+      ++pos;
+
+    bool isAppend = pos == sessions_.size();
+    sessions_.insert(sessions_.begin() + pos, sessionNo);
+    sequences_.insert(sequences_.begin() + pos, sequenceNo);
+    prefixOffsets_.insert(prefixOffsets_.begin() + pos, prefixArena_.size());
+    prefixLengths_.insert(prefixLengths_.begin() + pos, dataPrefix.size());
+    prefixArena_.append(dataPrefix);
+    nodeVersions_.insert(nodeVersions_.begin() + pos, 0);
+
+    if (!isAppend)
+      sessionIndex_.shiftFrom(pos);
+    for (uint32_t& index : rootOrder_) {
+      if (index >= pos)
+        ++index;
+    }
+    rootOrder_.insert(rootOrder_.begin() + rootPos, pos);
+    for (uint32_t& position : rootPositions_) {
+      if (position >= rootPos)
+        ++position;
+    }
+    rootPositions_.insert(rootPositions_.begin() + pos, rootPos);
+    int first = sessionIndex_.find(sessionNo);
+    if (first < 0 || (size_t)first > pos)
+      sessionIndex_.set(sessionNo, pos);
+
+    // The empty state is represented by "00".
+    if (sessions_.size() == 1)
+      vectorRoot_.clear();
+    insertEntry(vectorRoot_, rootOffsets_, rootPos, makeUserDigest(sessionNo, sequenceNo));
+    insertEntry(binaryRoot_, binaryOffsets_, pos,
+                encodeBinaryEntry(sessionNo, sequenceNo));
+    fingerprint_ += getEntryFingerprint(sessionNo, sequenceNo);
+    logChange(pos);
   }
 
-  recomputeVectorRoot();
+  NDN_LOG_DEBUG("update root to: " + vectorRoot_);
   return true;
 }
-void ICTVectorState::recomputeVectorRoot()
+
+size_t
+ICTVectorState::findRootPosition(const std::string& dataPrefix, int sessionNo) const
 {
-  std::string tempRoot;
-  for (size_t i = 0; i < digestNode_.size(); ++i)
-  {
-    tempRoot.append(digestNode_[i]->getUserDigest());
+  return std::lower_bound
+    (rootOrder_.begin(), rootOrder_.end(), 0,
+     [&] (uint32_t index, int) {
+       int comparison = prefixArena_.compare(prefixOffsets_[index], prefixLengths_[index],
+                                             dataPrefix);
+       if (comparison != 0)
+         return comparison < 0;
+       return sessions_[index] < sessionNo;
+     }) - rootOrder_.begin();
+}
+
+void
+ICTVectorState::logChange(size_t pos)
+{
+  ++version_;
+  nodeVersions_[pos] = version_;
+  changeLog_.push_back(sessions_[pos]);
+  // Once the log is much longer than the state, a full diff is cheaper than
+  // replaying it, so drop the older half.
+  if (changeLog_.size() > 2 * std::max<size_t>(sessions_.size(), 64)) {
+    size_t drop = changeLog_.size() / 2;
+    changeLog_.erase(changeLog_.begin(), changeLog_.begin() + drop);
+    changeLogStart_ += drop;
   }
+}
 
+void
+ICTVectorState::insertEntry(std::string& encoded, std::vector<uint32_t>& offsets,
+                            size_t pos, const std::string& entry)
+{
+  size_t offset = pos < offsets.size() ? offsets[pos] : encoded.size();
+  encoded.insert(offset, entry);
+  offsets.insert(offsets.begin() + pos, offset);
+  for (size_t i = pos + 1; i < offsets.size(); ++i)
+    offsets[i] += entry.size();
+}
 
-  vectorRoot_ = tempRoot;
-  //vectorRoot_ = toHex((uint8_t*)tempRoot.c_str(), sizeof((uint8_t*)tempRoot.c_str()));
-  NDN_LOG_DEBUG("update root to: " + vectorRoot_);
+void
+ICTVectorState::replaceEntry(std::string& encoded, std::vector<uint32_t>& offsets,
+                             size_t pos, const std::string& entry)
+{
+  size_t end = pos + 1 < offsets.size() ? offsets[pos + 1] : encoded.size();
+  size_t oldLength = end - offsets[pos];
+  encoded.replace(offsets[pos], oldLength, entry);
+  // Offsets only move when the encoded length changes.
+  if (entry.size() != oldLength) {
+    for (size_t i = pos + 1; i < offsets.size(); ++i)
+      offsets[i] = offsets[i] + entry.size() - oldLength;
+  }
 }
 
-int
-ICTVectorState::find(int sessionNo) const
+std::string
+ICTVectorState::encodeBinaryEntry(uint32_t sessionNo, uint32_t sequenceNo)
 {
-  for (size_t i = 0; i < digestNode_.size(); ++i) {
-    if (digestNode_[i]->getSessionNo() == sessionNo)
-      return i;
+  // NDN VAR-NUMBER: 1 byte below 253, otherwise a marker byte followed by a
+  // 2 or 4 byte big-endian value
+  std::string entry;
+  for (uint32_t value : {sessionNo, sequenceNo}) {
+    if (value < 253)
+      entry.push_back((char)value);
+    else if (value <= 0xFFFF) {
+      entry.push_back((char)253);
+      entry.push_back((char)(value >> 8));
+      entry.push_back((char)value);
+    }
+    else {
+      entry.push_back((char)254);
+      for (int shift = 24; shift >= 0; shift -= 8)
+        entry.push_back((char)(value >> shift));
+    }
   }
+  return entry;
+}
 
-  return -1;
+uint64_t
+ICTVectorState::getEntryFingerprint(uint32_t sessionNo, uint32_t sequenceNo)
+{
+  // splitmix64 finalizer over the packed entry
+  uint64_t z = ((uint64_t)sessionNo << 32 | sequenceNo) + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+size_t
+ICTVectorState::getMemoryUsage() const
+{
+  return sessions_.capacity() * sizeof(int32_t) +
+    sequences_.capacity() * sizeof(int32_t) +
+    prefixOffsets_.capacity() * sizeof(uint32_t) +
+    prefixLengths_.capacity() * sizeof(uint32_t) +
+    prefixArena_.capacity() +
+    vectorRoot_.capacity() + rootOffsets_.capacity() * sizeof(uint32_t) +
+    rootOrder_.capacity() * sizeof(uint32_t) + rootPositions_.capacity() * sizeof(uint32_t) +
+    binaryRoot_.capacity() + binaryOffsets_.capacity() * sizeof(uint32_t) +
+    compressedRoot_.capacity() +
+    nodeVersions_.capacity() * sizeof(uint64_t) +
+    changeLog_.capacity() * sizeof(uint32_t) +
+    sessionIndex_.getMemoryUsage() +
+    diffMarks_.capacity() +
+    remoteScratch_.sessions.capacity() * sizeof(uint32_t) +
+    remoteScratch_.sequences.capacity() * sizeof(uint32_t);
 }
+
 int
 ICTVectorState::find(const string& dataPrefix, int sessionNo) const
 {
-  for (size_t i = 0; i < digestNode_.size(); ++i) {
-    if (digestNode_[i]->getDataPrefix() == dataPrefix &&
-        digestNode_[i]->getSessionNo() == sessionNo)
+  int index = sessionIndex_.find(sessionNo);
+  if (index < 0)
+    return -1;
+
+  // nodes with the same session are adjacent
+  for (size_t i = index; i < sessions_.size() && sessions_[i] == sessionNo; ++i) {
+    if (hasDataPrefix(i, dataPrefix))
       return i;
   }
 
@@ -122,10 +255,9 @@ ICTVectorState::find(const string& dataPrefix, int sessionNo) const
 const std::string
 ICTVectorState::getSessionName(int sessionNo) const
 {
-  for (size_t i = 0; i < digestNode_.size(); ++i) {
-    if (digestNode_[i]->getSessionNo() == sessionNo)
-      return digestNode_[i]->getDataPrefix();
-  }
+  int index = find(sessionNo);
+  if (index >= 0)
+    return get(index).getDataPrefix();
   NDN_LOG_DEBUG("Could not find session " << sessionNo << " Return empty string");
   return {};
 }
@@ -146,95 +278,359 @@ ICTVectorState::getSessionName(int sessionNo) const
 
 int
 ICTVectorState::getDiff(const std::string& rState,
-                    std::vector<uint8_t>& positiveLocalIndexes,
+                    std::vector<uint32_t>& positiveLocalIndexes,
                     std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
                     std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
-                    bool pushLocalSessions) const
+                    bool& pushLocalSessions) const
                     //std::vector<uint32_t>& unknownSessions) const
 {
-  pushLocalSessions = false;
   NDN_LOG_DEBUG("In getDiff ");
 
-  positiveLocalIndexes.clear();
-  negativeInLocal.clear();
-  unknownSessions.clear();
-
-  // parse rState into
-  std::string nodeDelimiter = ";";
-  std::string dataDelimiter = ",";
-
-  std::string tmpRState(unescape(rState));
+  // rState is the escaped URI form, so decode %XX while parsing
+  remoteScratch_.sessions.clear();
+  remoteScratch_.sequences.clear();
+  parseTextState((const uint8_t*)rState.data(), rState.size(), true,
+                 remoteScratch_.sessions, remoteScratch_.sequences);
+  checkSorted(remoteScratch_);
+  return computeDiff(remoteScratch_, positiveLocalIndexes, negativeInLocal,
+                     unknownSessions, pushLocalSessions);
+}
 
-  //NDN_LOG_DEBUG("tmpRState: " + tmpRState);
+int
+ICTVectorState::getDiff(const uint8_t* state, size_t size, StateEncoding encoding,
+                        std::vector<uint32_t>& positiveLocalIndexes,
+                        std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                        std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+                        bool& pushLocalSessions) const
+{
+  parseState(state, size, encoding, remoteScratch_);
+  return computeDiff(remoteScratch_, positiveLocalIndexes, negativeInLocal,
+                     unknownSessions, pushLocalSessions);
+}
 
-  using tpl = std::tuple<uint32_t, uint32_t>;
+int
+ICTVectorState::getDiff(const RemoteState& remote,
+                        std::vector<uint32_t>& positiveLocalIndexes,
+                        std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                        std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+                        bool& pushLocalSessions) const
+{
+  return computeDiff(remote, positiveLocalIndexes, negativeInLocal,
+                     unknownSessions, pushLocalSessions);
+}
 
-  boost::spirit::qi::rule<std::string::iterator, tpl()> parse_into_tuple =
-    boost::spirit::qi::int_ >> ',' >> boost::spirit::qi::int_;
+/**
+ * Get the index of the first entry of remote with the given session, or -1.
+ */
+static int
+findRemoteEntry(const ICTVectorState::RemoteState& remote, uint32_t sessionNo)
+{
+  std::vector<uint32_t>::const_iterator entry;
+  if (remote.isSorted) {
+    entry = std::lower_bound(remote.sessions.begin(), remote.sessions.end(), sessionNo);
+    if (entry != remote.sessions.end() && *entry != sessionNo)
+      entry = remote.sessions.end();
+  }
+  else
+    entry = std::find(remote.sessions.begin(), remote.sessions.end(), sessionNo);
 
-  boost::spirit::qi::rule<std::string::iterator, std::vector<tpl>() > parse_into_vec = parse_into_tuple % ';';
+  return entry == remote.sessions.end() ? -1 : entry - remote.sessions.begin();
+}
 
-  std::vector<tpl> remoteVector;
-  bool b = boost::spirit::qi::parse(tmpRState.begin(), tmpRState.end(), parse_into_vec, remoteVector);
-  for (const auto &t : remoteVector)
-  {
-      NDN_LOG_DEBUG("Remote parsed: " << std::get<0>(t) << ", " << std::get<1>(t));
+int
+ICTVectorState::getDiffSince(const RemoteState& remote, uint64_t version,
+                             std::vector<uint32_t>& positiveLocalIndexes,
+                             bool& pushLocalSessions) const
+{
+  pushLocalSessions = false;
+  if (version + 1 < changeLogStart_) {
+    NDN_LOG_DEBUG("getDiffSince: version " << version << " was trimmed, full diff");
+    std::vector<std::tuple<uint32_t, uint32_t>> negativeInLocal;
+    std::vector<std::tuple<uint32_t, uint32_t>> unknownSessions;
+    return computeDiff(remote, positiveLocalIndexes, negativeInLocal,
+                       unknownSessions, pushLocalSessions);
   }
-  NDN_LOG_DEBUG("Local state is: " <<   vectorRoot_);
-  // Go over local tree
-  // if local has something that remote doesn't: add to index list
-  // if local has an up-to-date seq of a recognized local - add to index list
-  for (size_t i = 0; i < digestNode_.size(); ++i)
+
+  positiveLocalIndexes.clear();
+  for (size_t k = version + 1 - changeLogStart_; k < changeLog_.size(); ++k)
   {
-    NDN_LOG_DEBUG("Local node session is: " <<   digestNode_[i]->getSessionNo());
-    bool foundInLocal = false;
+    uint32_t sessionNo = changeLog_[k];
+    int first = sessionIndex_.find(sessionNo);
+    if (first < 0)
+      continue;
 
-    // TBD: change the for to while r.session < digestNode_[i]
-    // because both lists should be sorted
-    for (const auto &r : remoteVector)
+    for (size_t i = first; i < sessions_.size() &&
+           (uint32_t)sessions_[i] == sessionNo; ++i)
     {
-      NDN_LOG_DEBUG("Remote node session is: " << std::get<0>(r));
-      if (digestNode_[i]->getSessionNo() == std::get<0>(r))
+      // compare each node once, at the last version it changed
+      if (nodeVersions_[i] != changeLogStart_ + k)
+        continue;
+
+      int j = findRemoteEntry(remote, sessionNo);
+      if (j < 0)
       {
-        NDN_LOG_DEBUG("found remote session in local ");
-        // only add to positiveLocalIndexes if local is newer than recieved
-        if (digestNode_[i]->getSequenceNo() > std::get<1>(r))
-        {
-          positiveLocalIndexes.push_back(i);
-          NDN_LOG_DEBUG("local seq (" << digestNode_[i]->getSequenceNo() <<
-                    ")is higher than remote(" << std::get<1>(r) << ")");
-        }
-        // if remote seq is greater up-to-date add to negativeInLocal
-        if (digestNode_[i]->getSequenceNo() < std::get<1>(r))
-        {
-          negativeInLocal.push_back(std::make_tuple(std::get<0>(r), std::get<1>(r)));
-          NDN_LOG_DEBUG("local seq (" << digestNode_[i]->getSequenceNo() <<
-                    ")is lower than remote(" << std::get<1>(r) << ")");
-        }
-
-        foundInLocal = true;
-        break;
+        pushLocalSessions = true;
+        positiveLocalIndexes.push_back(i);
+      }
+      else if ((uint32_t)sequences_[i] > remote.sequences[j])
+        positiveLocalIndexes.push_back(i);
+    }
+  }
+  std::sort(positiveLocalIndexes.begin(), positiveLocalIndexes.end());
+
+  if(positiveLocalIndexes.size() > 0)
+    return positiveLocalIndexes.size();
+  else
+    return -1;
+}
+
+void
+ICTVectorState::parseState(const uint8_t* state, size_t size, StateEncoding encoding,
+                           RemoteState& remote)
+{
+  remote.sessions.clear();
+  remote.sequences.clear();
+  if (encoding == STATE_ENCODING_BINARY)
+    parseBinaryState(state, size, remote.sessions, remote.sequences);
+  else if (encoding == STATE_ENCODING_COMPRESSED)
+    parseCompressedState(state, size, remote.sessions, remote.sequences);
+  else
+    // the raw component value is not escaped
+    parseTextState(state, size, false, remote.sessions, remote.sequences);
+  checkSorted(remote);
+}
+
+void
+ICTVectorState::checkSorted(RemoteState& remote)
+{
+  remote.isSorted = true;
+  for (size_t j = 1; j < remote.sessions.size() && remote.isSorted; ++j)
+    remote.isSorted = remote.sessions[j - 1] < remote.sessions[j];
+}
+
+void
+ICTVectorState::parseTextState(const uint8_t* state, size_t size, bool isEscaped,
+                               std::vector<uint32_t>& sessions,
+                               std::vector<uint32_t>& sequences)
+{
+  // Parse "sess,seq;sess,seq;..." in place. Like the grammar it replaces
+  // (int_ >> ',' >> int_) % ';', stop at the first malformed input and
+  // keep every complete entry parsed before it.
+  const uint8_t* end = state + size;
+  uint32_t sessionNo = 0;
+  bool inSequence = false;
+  uint64_t number = 0;
+  int digits = 0;
+  bool hasSign = false;
+  bool negative = false;
+
+  while (state < end) {
+    uint8_t c = *state++;
+    if (isEscaped && c == '%' && end - state >= 2) {
+      int hi = fromHexChar(state[0]);
+      int lo = fromHexChar(state[1]);
+      if (hi >= 0 && lo >= 0) {
+        c = (uint8_t)(16 * hi + lo);
+        state += 2;
       }
+    }
 
+    if (c >= '0' && c <= '9') {
+      number = number * 10 + (c - '0');
+      // int_ overflow fails the whole entry
+      if (number > (negative ? 0x80000000ULL : 0x7FFFFFFFULL))
+        return;
+      ++digits;
     }
-    if (!foundInLocal)
-    {
-      pushLocalSessions = true;
-      NDN_LOG_DEBUG("local was not found in remote. Adding to response");
-      positiveLocalIndexes.push_back(i);
+    else if ((c == '-' || c == '+') && digits == 0 && !hasSign) {
+      hasSign = true;
+      negative = c == '-';
+    }
+    else if (digits > 0 && c == (inSequence ? ';' : ',')) {
+      uint32_t value = negative ? (uint32_t)(0 - number) : (uint32_t)number;
+      if (inSequence) {
+        sessions.push_back(sessionNo);
+        sequences.push_back(value);
+      }
+      else
+        sessionNo = value;
+      inSequence = !inSequence;
+      number = 0;
+      digits = 0;
+      hasSign = false;
+      negative = false;
+    }
+    else
+      break;
+  }
+
+  // the last entry may omit the trailing ';'
+  if (inSequence && digits > 0) {
+    sessions.push_back(sessionNo);
+    sequences.push_back(negative ? (uint32_t)(0 - number) : (uint32_t)number);
+  }
+}
+
+void
+ICTVectorState::parseBinaryState(const uint8_t* state, size_t size,
+                                 std::vector<uint32_t>& sessions,
+                                 std::vector<uint32_t>& sequences)
+{
+  const uint8_t* end = state + size;
+  auto readVarNumber = [&] (uint32_t& value) {
+    if (state >= end)
+      return false;
+    uint8_t first = *state++;
+    size_t length = first < 253 ? 0 : first == 253 ? 2 : first == 254 ? 4 : 8;
+    if (length == 0) {
+      value = first;
+      return true;
+    }
+    if ((size_t)(end - state) < length)
+      return false;
+    uint64_t number = 0;
+    for (size_t i = 0; i < length; ++i)
+      number = (number << 8) | *state++;
+    value = (uint32_t)number;
+    return true;
+  };
+
+  uint32_t sessionNo, sequenceNo;
+  while (readVarNumber(sessionNo) && readVarNumber(sequenceNo)) {
+    sessions.push_back(sessionNo);
+    sequences.push_back(sequenceNo);
+  }
+}
+
+// Below this many bytes of varints, gzip's 18 bytes of header and trailer
+// are not worth it.
+static const size_t MIN_GZIP_STATE_SIZE = 64;
+
+static void
+appendVarint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+std::string
+ICTVectorState::encodeCompressedState(const uint32_t* sessions, const uint32_t* sequences,
+                                      size_t size)
+{
+  std::string varints;
+  varints.reserve(size * 4);
+  uint32_t previousSession = 0;
+  uint32_t previousSequence = 0;
+  for (size_t i = 0; i < size; ++i) {
+    appendVarint(varints, sessions[i] - previousSession);
+    int64_t delta = (int64_t)sequences[i] - (int64_t)previousSequence;
+    appendVarint(varints, (uint64_t)((delta << 1) ^ (delta >> 63)));
+    previousSession = sessions[i];
+    previousSequence = sequences[i];
+  }
+
+  std::string state(1, (char)COMPRESSED_FORMAT_RAW);
+  if (varints.size() >= MIN_GZIP_STATE_SIZE) {
+    std::string compressed = Gzip::compress(varints);
+    if (compressed.size() < varints.size()) {
+      state[0] = (char)COMPRESSED_FORMAT_GZIP;
+      return state.append(compressed);
+    }
+  }
+  return state.append(varints);
+}
+
+const std::string&
+ICTVectorState::getCompressedState() const
+{
+  if (compressedRootVersion_ != version_) {
+    compressedRoot_ = encodeCompressedState((const uint32_t*)sessions_.data(),
+                                            (const uint32_t*)sequences_.data(),
+                                            sessions_.size());
+    compressedRootVersion_ = version_;
+  }
+  return compressedRoot_;
+}
+
+void
+ICTVectorState::parseCompressedState(const uint8_t* state, size_t size,
+                                     std::vector<uint32_t>& sessions,
+                                     std::vector<uint32_t>& sequences)
+{
+  if (size == 0)
+    return;
+
+  std::string decompressed;
+  const uint8_t* end = state + size;
+  uint8_t format = *state++;
+  if (format == COMPRESSED_FORMAT_GZIP) {
+    try {
+      decompressed = Gzip::decompress(std::string((const char*)state, end - state),
+                                      Gzip::MAX_DECOMPRESSED_SIZE);
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_DEBUG("Bad compressed state: " << e.what());
+      return;
+    }
+    state = (const uint8_t*)decompressed.data();
+    end = state + decompressed.size();
+  }
+  else if (format != COMPRESSED_FORMAT_RAW)
+    return;
+
+  auto readVarint = [&] (uint64_t& value) {
+    value = 0;
+    for (int shift = 0; state < end && shift < 64; shift += 7) {
+      uint8_t byte = *state++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
     }
+    return false;
+  };
+
+  uint32_t sessionNo = 0;
+  uint32_t sequenceNo = 0;
+  uint64_t sessionDelta, sequenceDelta;
+  while (readVarint(sessionDelta) && readVarint(sequenceDelta)) {
+    sessionNo += (uint32_t)sessionDelta;
+    int64_t delta = (int64_t)(sequenceDelta >> 1) ^ -(int64_t)(sequenceDelta & 1);
+    sequenceNo = (uint32_t)((int64_t)sequenceNo + delta);
+    sessions.push_back(sessionNo);
+    sequences.push_back(sequenceNo);
   }
+}
 
-  // go over remoteVector to check if there is something in remote that is
-  // unknown to local. If so, add to negative list
-  for (const auto &r : remoteVector)
+int
+ICTVectorState::computeDiff(const RemoteState& remote,
+                            std::vector<uint32_t>& positiveLocalIndexes,
+                            std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                            std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+                            bool& pushLocalSessions) const
+{
+  NDN_LOG_DEBUG("In computeDiff ");
+
+  for (size_t j = 0; j < remote.sessions.size(); ++j)
   {
-    // if remote session id not found in local
-    if(find(std::get<0>(r)) == -1)
-      unknownSessions.push_back(std::make_tuple(std::get<0>(r), std::get<1>(r)));
-      //unknownSessions.push_back(std::get<0>(r));
+      NDN_LOG_DEBUG("Remote parsed: " << remote.sessions[j] << ", " << remote.sequences[j]);
   }
+  NDN_LOG_DEBUG("Local state is: " <<   vectorRoot_);
 
+  // Binary and compressed states are sorted by session like our nodes, so
+  // both sides can be merged in one pass by the diff kernel. A text root is
+  // sorted by data prefix, so its sessions are looked up in the index.
+  if (remote.isSorted) {
+    pushLocalSessions = diffSortedStates
+      ((const uint32_t*)sessions_.data(), (const uint32_t*)sequences_.data(), sessions_.size(),
+       remote.sessions.data(), remote.sequences.data(), remote.sessions.size(),
+       positiveLocalIndexes, negativeInLocal, unknownSessions);
+  }
+  else
+    pushLocalSessions = computeUnsortedDiff(remote, positiveLocalIndexes, negativeInLocal,
+                                            unknownSessions);
 
   if(positiveLocalIndexes.size() > 0)
     return positiveLocalIndexes.size();
@@ -242,25 +638,148 @@ ICTVectorState::getDiff(const std::string& rState,
     return -1;
 }
 
-void
-ICTVectorState::Node::recomputeUserDigest()
+bool
+ICTVectorState::computeUnsortedDiff(const RemoteState& remote,
+                                    std::vector<uint32_t>& positiveLocalIndexes,
+                                    std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                                    std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions) const
+{
+  bool pushLocalSessions = false;
+  positiveLocalIndexes.clear();
+  negativeInLocal.clear();
+  unknownSessions.clear();
+
+  // Walk the remote vector once and look each session up in the session
+  // index. diffMarks_ records, per local node, whether it was matched by a
+  // remote entry and whether local is newer than remote.
+  enum : uint8_t { NOT_IN_REMOTE = 0, MATCHED = 1, LOCAL_NEWER = 2 };
+  diffMarks_.assign(sessions_.size(), NOT_IN_REMOTE);
+
+  for (size_t j = 0; j < remote.sessions.size(); ++j)
+  {
+    uint32_t remoteSession = remote.sessions[j];
+    uint32_t remoteSequence = remote.sequences[j];
+    NDN_LOG_DEBUG("Remote node session is: " << remoteSession);
+    int first = sessionIndex_.find(remoteSession);
+    if (first < 0)
+    {
+      // remote session id not found in local
+      unknownSessions.push_back(std::make_tuple(remoteSession, remoteSequence));
+      continue;
+    }
+
+    // nodes with the same session are adjacent
+    for (size_t i = first; i < sessions_.size() &&
+           (uint32_t)sessions_[i] == remoteSession; ++i)
+    {
+      // only the first remote entry for a session is compared
+      if (diffMarks_[i] != NOT_IN_REMOTE)
+        continue;
+
+      NDN_LOG_DEBUG("found remote session in local ");
+      diffMarks_[i] = MATCHED;
+      // only add to positiveLocalIndexes if local is newer than recieved
+      if ((uint32_t)sequences_[i] > remoteSequence)
+      {
+        diffMarks_[i] = LOCAL_NEWER;
+        NDN_LOG_DEBUG("local seq (" << sequences_[i] <<
+                  ")is higher than remote(" << remoteSequence << ")");
+      }
+      // if remote seq is greater up-to-date add to negativeInLocal
+      if ((uint32_t)sequences_[i] < remoteSequence)
+      {
+        negativeInLocal.push_back(std::make_tuple(remoteSession, remoteSequence));
+        NDN_LOG_DEBUG("local seq (" << sequences_[i] <<
+                  ")is lower than remote(" << remoteSequence << ")");
+      }
+    }
+  }
+
+  // Go over local tree in order
+  // if local has something that remote doesn't: add to index list
+  // if local has an up-to-date seq of a recognized local - add to index list
+  for (size_t i = 0; i < sessions_.size(); ++i)
+  {
+    if (diffMarks_[i] == NOT_IN_REMOTE)
+    {
+      pushLocalSessions = true;
+      NDN_LOG_DEBUG("local session " << sessions_[i]
+                    << " was not found in remote. Adding to response");
+      positiveLocalIndexes.push_back(i);
+    }
+    else if (diffMarks_[i] == LOCAL_NEWER)
+      positiveLocalIndexes.push_back(i);
+  }
+
+  return pushLocalSessions;
+}
+
+std::string
+ICTVectorState::makeUserDigest(int sessionNo, int sequenceNo)
 {
   // For now, encode a digest to be simply
-  // "DataName,sessionNo,SeqNum"
+  // "sessionNo,SeqNum;"
 
   std::string userDigest;
-  userDigest.append(std::to_string(sessionNo_));
-  userDigest.append(",").append(std::to_string(sequenceNo_));
+  userDigest.append(std::to_string(sessionNo));
+  userDigest.append(",").append(std::to_string(sequenceNo));
   userDigest.append(";");
-  userDigest_ = userDigest;
+  return userDigest;
+}
+
+int
+ICTVectorState::SessionIndex::find(uint32_t sessionNo) const
+{
+  if (slots_.empty())
+    return -1;
 
+  const Slot& slot = slots_[getSlot(sessionNo)];
+  return slot.index == EMPTY ? -1 : (int)slot.index;
 }
+
+void
+ICTVectorState::SessionIndex::set(uint32_t sessionNo, uint32_t index)
+{
+  if ((size_ + 1) * 2 > slots_.size())
+    grow();
+
+  Slot& slot = slots_[getSlot(sessionNo)];
+  if (slot.index == EMPTY) {
+    slot.sessionNo = sessionNo;
+    ++size_;
+  }
+  slot.index = index;
+}
+
+void
+ICTVectorState::SessionIndex::shiftFrom(uint32_t pos)
+{
+  for (Slot& slot : slots_) {
+    if (slot.index != EMPTY && slot.index >= pos)
+      ++slot.index;
+  }
+}
+
+size_t
+ICTVectorState::SessionIndex::getSlot(uint32_t sessionNo) const
+{
+  // Fibonacci hashing and linear probing. slots_.size() is a power of 2 and
+  // the table is at most half full, so the probe always terminates.
+  size_t mask = slots_.size() - 1;
+  size_t i = (size_t)((sessionNo * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+  while (slots_[i].index != EMPTY && slots_[i].sessionNo != sessionNo)
+    i = (i + 1) & mask;
+  return i;
+}
+
 void
-ICTVectorState::Node::int32ToLittleEndian(uint32_t value, uint8_t* result)
+ICTVectorState::SessionIndex::grow()
 {
-  for (size_t i = 0; i < 4; i++) {
-    result[i] = value % 256;
-    value = value / 256;
+  std::vector<Slot> oldSlots(std::max<size_t>(16, slots_.size() * 2), Slot{0, EMPTY});
+  oldSlots.swap(slots_);
+  for (const Slot& slot : oldSlots) {
+    if (slot.index != EMPTY)
+      slots_[getSlot(slot.sessionNo)] = slot;
   }
 }
 
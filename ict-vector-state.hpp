@@ -28,99 +28,118 @@
 
 //#include <ndn-cpp/common.hpp>
 #include <sstream>
+#include <stdexcept>
 #include <boost/iostreams/filtering_streambuf.hpp>
-//#include <boost/iostreams/copy.hpp>
-//#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 #include <string>
+#include <vector>
+#include <memory>
+#include <tuple>
 
 namespace ict {
+
+/**
+ * How the state vector is carried in the sync interest name. Every node
+ * decodes both forms, so the encoding only selects what a node sends and is
+ * configured per sync group.
+ */
+enum StateEncoding {
+  // "sess,seq;" text in a generic name component (the original format)
+  STATE_ENCODING_TEXT = 0,
+  // session-sorted (session, seq) pairs written as VAR-NUMBERs in a name
+  // component of type ICTVectorState::BINARY_STATE_COMPONENT_TYPE
+  STATE_ENCODING_BINARY = 1,
+  // session-sorted entries as delta-varints, gzipped when that makes them
+  // smaller, in a component of type
+  // ICTVectorState::COMPRESSED_STATE_COMPONENT_TYPE. A node using it also
+  // gzips the content of its sync Data when that makes it smaller.
+  STATE_ENCODING_COMPRESSED = 2
+};
+
 class ICTVectorState {
 public:
+  /**
+   * TLV-TYPE of the name component carrying a STATE_ENCODING_BINARY state.
+   */
+  static const uint32_t BINARY_STATE_COMPONENT_TYPE = 252;
+
+  /**
+   * TLV-TYPE of the name component which stands for a state carried in the
+   * ApplicationParameters of a sync interest. Its value is the fingerprint
+   * (8 bytes) and size (4 bytes) of the state, big-endian.
+   */
+  static const uint32_t STATE_DIGEST_COMPONENT_TYPE = 253;
+
+  /**
+   * TLV-TYPE of the name component carrying a STATE_ENCODING_COMPRESSED
+   * state. Its value is a format byte, COMPRESSED_FORMAT_RAW or
+   * COMPRESSED_FORMAT_GZIP, then for each entry in session order the session
+   * minus the previous session and the zigzag encoded sequence minus the
+   * previous sequence, as 7-bit varints. With COMPRESSED_FORMAT_GZIP the
+   * varints are gzipped.
+   */
+  static const uint32_t COMPRESSED_STATE_COMPONENT_TYPE = 254;
+  static const uint8_t COMPRESSED_FORMAT_RAW = 0;
+  static const uint8_t COMPRESSED_FORMAT_GZIP = 1;
+
   ICTVectorState()
   //: root_("00")
   : vectorRoot_("00")
   {}
 
+  /**
+   * A Node is a lightweight view of one entry of the state. The entries are
+   * kept in parallel arrays inside ICTVectorState (session ids, sequence
+   * numbers and offsets into a shared prefix arena) rather than as separate
+   * heap objects, so a Node is only valid until the next update().
+   */
   class Node {
   public:
-    /**
-     * Create a new ICTVectorState::Node with the given fields and compute the digest.
-     * @param dataPrefix The data prefix.
-     * @param sessionNo The sequence number.
-     * @param sequenceNo The session number.
-     */
-    Node(const std::string& dataPrefix, int sessionNo, int sequenceNo)
-    : dataPrefix_(dataPrefix),
-      sessionNo_(sessionNo),
-      sequenceNo_(sequenceNo)
+    Node(const ICTVectorState& state, size_t index)
+    : state_(&state), index_(index)
     {
-      recomputeUserDigest();
     }
 
-    const std::string&
-    getDataPrefix() const { return dataPrefix_; }
+    std::string
+    getDataPrefix() const
+    {
+      return state_->prefixArena_.substr(state_->prefixOffsets_[index_],
+                                         state_->prefixLengths_[index_]);
+    }
 
     int
-    getSessionNo() const { return sessionNo_; }
+    getSessionNo() const { return state_->sessions_[index_]; }
 
     int
-    getSequenceNo() const { return sequenceNo_; }
-
-    /**
-     * Get the user's digest. A user digest is the sha256 of user data name and session id
-     * @return The user data name digest as a hex string.
-     */
-    const std::string&
-    getUserDigest() const { return userDigest_; }
+    getSequenceNo() const { return state_->sequences_[index_]; }
 
     /**
-     * Set the sequence number and recompute the digest.
-     * @param sequenceNo The new sequence number.
+     * Get the user's digest, the "sessionNo,sequenceNo;" entry of this node
+     * in the vector root.
      */
-    void
-    setSequenceNo(int sequenceNo)
+    std::string
+    getUserDigest() const
     {
-      sequenceNo_ = sequenceNo;
-
-      recomputeUserDigest();
+      return makeUserDigest(getSessionNo(), getSequenceNo());
     }
 
-    /**
-     * Compare shared_ptrs to Node based on dataPrefix_ and seqno_session_.
-     */
-    class Compare {
-    public:
-      bool
-      operator()
-        (const std::shared_ptr<const Node>& node1,
-         const std::shared_ptr<const Node>& node2) const
-      {
-        int nameComparison = node1->dataPrefix_.compare(node2->dataPrefix_);
-        if (nameComparison != 0)
-          return nameComparison < 0;
-
-        return node1->sessionNo_ < node2->sessionNo_;
-      }
-    };
-
-
   private:
+    const ICTVectorState* state_;
+    size_t index_;
+  };
 
-    /**
-     * comupte a digest based on dataPrefix_ and sessionNo and set userDigest_ to the hex digest.
-     */
-    void
-    recomputeUserDigest();
-
-    static void
-    int32ToLittleEndian(uint32_t value, uint8_t* result);
-
-    std::string dataPrefix_;
-    int sessionNo_;
-    int sequenceNo_;
-
-    // digest based on session id and seq number
-    std::string userDigest_;
+  /**
+   * The (session, sequence) entries of a remote state, parsed once by
+   * parseState so that they can be diffed again with getDiffSince as the
+   * local state changes.
+   */
+  struct RemoteState {
+    std::vector<uint32_t> sessions;
+    std::vector<uint32_t> sequences;
+    // true if sessions is strictly increasing, as in a peer's binary or
+    // compressed state
+    bool isSorted = true;
   };
 
   /**
@@ -136,43 +155,354 @@ public:
   bool
   update(const std::string& dataPrefix, int sessionNo, int sequenceNo);
 
+  /**
+   * Find the node for the given dataPrefix and sessionNo. Nodes are sorted by
+   * session, so this looks up the session and checks the (almost always
+   * single) nodes with that session.
+   * @return The index of the node in the sorted list, or -1 if not found.
+   */
   int
   find(const std::string& dataPrefix, int sessionNo) const;
 
+  /**
+   * Find the first node (in sorted order) with the given sessionNo using the
+   * session index.
+   * @return The index of the node in the sorted list, or -1 if not found.
+   */
   int
-  find(int sessionNo) const;
+  find(int sessionNo) const { return sessionIndex_.find(sessionNo); }
 
   const std::string
   getSessionName(int sessionNo) const;
 
   size_t
-  size() const { return digestNode_.size(); }
+  size() const { return sessions_.size(); }
 
-  const ICTVectorState::Node&
-  get(size_t i) const { return *digestNode_[i]; }
+  ICTVectorState::Node
+  get(size_t i) const { return Node(*this, i); }
 
   const std::string&
   getVectorRoot() const { return vectorRoot_; }
 
+  /**
+   * Check if the given bytes (the raw value of a sync name component) are
+   * the same as the vector root. The size is compared first, so most
+   * mismatches are rejected without looking at the bytes.
+   */
+  bool
+  isVectorRoot(const uint8_t* value, size_t size) const
+  {
+    return size == vectorRoot_.size() &&
+      (size == 0 || vectorRoot_.compare(0, size, (const char*)value, size) == 0);
+  }
+
+  /**
+   * Get the state as written in a STATE_ENCODING_BINARY name component.
+   * Like the vector root, it is maintained incrementally by update().
+   */
+  const std::string&
+  getBinaryState() const { return binaryRoot_; }
+
+  /**
+   * Check if the given bytes are the same as getBinaryState().
+   */
+  bool
+  isBinaryState(const uint8_t* value, size_t size) const
+  {
+    return size == binaryRoot_.size() &&
+      (size == 0 || binaryRoot_.compare(0, size, (const char*)value, size) == 0);
+  }
+
+  /**
+   * Get the state as written in a STATE_ENCODING_COMPRESSED name component.
+   * Unlike the other encodings it is not maintained by update(), but built
+   * when first asked for at each version.
+   */
+  const std::string&
+  getCompressedState() const;
+
+  /**
+   * Check if the given bytes are the same as getCompressedState().
+   */
+  bool
+  isCompressedState(const uint8_t* value, size_t size) const
+  {
+    const std::string& state = getCompressedState();
+    return size == state.size() &&
+      (size == 0 || state.compare(0, size, (const char*)value, size) == 0);
+  }
+
+  /**
+   * Write the given entries, sorted by session, as the value of a
+   * STATE_ENCODING_COMPRESSED name component.
+   */
+  static std::string
+  encodeCompressedState(const uint32_t* sessions, const uint32_t* sequences, size_t size);
+
+  /**
+   * Get the rolling fingerprint of the state. This is the sum of
+   * getEntryFingerprint for every (session, sequence) entry, maintained
+   * incrementally by update(), so two states can be compared in O(1).
+   */
+  uint64_t
+  getFingerprint() const { return fingerprint_; }
+
+  /**
+   * Get the fingerprint contribution of a single (session, sequence) entry.
+   */
+  static uint64_t
+  getEntryFingerprint(uint32_t sessionNo, uint32_t sequenceNo);
+
+  /**
+   * Get the version of the state. It starts at 0 and every update() which
+   * changes a node increments it and stamps the node with the new version,
+   * so the nodes changed since a version can be found with getDiffSince.
+   */
+  uint64_t
+  getVersion() const { return version_; }
+
+  /**
+   * Get the approximate number of bytes used by the state, its encodings
+   * and indexes.
+   */
+  size_t
+  getMemoryUsage() const;
+
   int
   getDiff(const std::string& digest,
-          std::vector<uint8_t>& diffNodes,
+          std::vector<uint32_t>& diffNodes,
           std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
           std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
-          bool pushLocalSessions) const;
+          bool& pushLocalSessions) const;
           //std::vector<uint32_t>& unknownSessions) const;
+
+  /**
+   * Same as getDiff above, but take the raw value of the state name component
+   * in the given encoding.
+   */
+  int
+  getDiff(const uint8_t* state, size_t size, StateEncoding encoding,
+          std::vector<uint32_t>& diffNodes,
+          std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+          std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+          bool& pushLocalSessions) const;
+
+  /**
+   * Same as getDiff above, but take an already parsed remote state.
+   */
+  int
+  getDiff(const RemoteState& remote,
+          std::vector<uint32_t>& diffNodes,
+          std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+          std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+          bool& pushLocalSessions) const;
+
+  /**
+   * Find the local nodes which are newer than remote (or not in remote),
+   * given that none were at the given version, i.e. getDiff against remote
+   * found no positive indexes when getVersion() was version. Only the nodes
+   * changed since then are compared, unless the change log no longer reaches
+   * back to version, in which case this is a full getDiff.
+   * @param positiveLocalIndexes Set to the local indexes, in order.
+   * @param pushLocalSessions Set true if a local session was not found in
+   * remote.
+   * @return The number of positive indexes, or -1 if there are none.
+   */
+  int
+  getDiffSince(const RemoteState& remote, uint64_t version,
+               std::vector<uint32_t>& positiveLocalIndexes,
+               bool& pushLocalSessions) const;
+
+  /**
+   * Parse the raw value of a state name component in the given encoding.
+   */
+  static void
+  parseState(const uint8_t* state, size_t size, StateEncoding encoding,
+             RemoteState& remote);
 private:
   /**
-   * Set vectorRoot_ to a vector of ...
+   * Open-addressing hash table from session id to the index of the first
+   * node with that session. A slot is 8 bytes and the table is kept at most
+   * half full, which is far smaller than a heap node per entry.
+   */
+  class SessionIndex {
+  public:
+    /**
+     * @return The index stored for sessionNo, or -1 if there is none.
+     */
+    int
+    find(uint32_t sessionNo) const;
+
+    /**
+     * Set the index stored for sessionNo, adding it if needed.
+     */
+    void
+    set(uint32_t sessionNo, uint32_t index);
+
+    /**
+     * Add one to every stored index which is at least pos.
+     */
+    void
+    shiftFrom(uint32_t pos);
+
+    size_t
+    getMemoryUsage() const { return slots_.capacity() * sizeof(Slot); }
+
+  private:
+    struct Slot {
+      uint32_t sessionNo;
+      uint32_t index;
+    };
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+
+    size_t
+    getSlot(uint32_t sessionNo) const;
+
+    void
+    grow();
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+  };
+
+  /**
+   * Get the "sessionNo,sequenceNo;" entry of the vector root.
+   */
+  static std::string
+  makeUserDigest(int sessionNo, int sequenceNo);
+
+  /**
+   * Diff the parsed remote vector against the local state. See getDiff.
+   */
+  int
+  computeDiff(const RemoteState& remote,
+              std::vector<uint32_t>& positiveLocalIndexes,
+              std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+              std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions,
+              bool& pushLocalSessions) const;
+
+  /**
+   * Diff a remote vector which is not sorted by session, by looking each
+   * remote session up in the session index.
+   * @return True if a local session was not found in remote.
+   */
+  bool
+  computeUnsortedDiff(const RemoteState& remote,
+                      std::vector<uint32_t>& positiveLocalIndexes,
+                      std::vector<std::tuple<uint32_t, uint32_t>>& negativeInLocal,
+                      std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions) const;
+
+  /**
+   * Parse a text state into the parallel arrays sessions and sequences
+   * without copying it. If isEscaped, state is in URI form and %XX escapes
+   * are decoded as they are read.
+   */
+  static void
+  parseTextState(const uint8_t* state, size_t size, bool isEscaped,
+                 std::vector<uint32_t>& sessions, std::vector<uint32_t>& sequences);
+
+  static void
+  parseBinaryState(const uint8_t* state, size_t size,
+                   std::vector<uint32_t>& sessions, std::vector<uint32_t>& sequences);
+
+  /**
+   * Parse a STATE_ENCODING_COMPRESSED value. Like the other parsers, stop at
+   * the first malformed input.
+   */
+  static void
+  parseCompressedState(const uint8_t* state, size_t size,
+                       std::vector<uint32_t>& sessions, std::vector<uint32_t>& sequences);
+
+  /**
+   * Set remote.isSorted from remote.sessions.
+   */
+  static void
+  checkSorted(RemoteState& remote);
+
+  /**
+   * Record that node pos now has the new version_, and trim the change log.
+   */
+  void
+  logChange(size_t pos);
+
+  /**
+   * Get the STATE_ENCODING_BINARY encoding of one entry.
    */
-   void recomputeVectorRoot(); // new function to replace old hex root
-  // void
-  // recomputeRoot(); // deprecated
+  static std::string
+  encodeBinaryEntry(uint32_t sessionNo, uint32_t sequenceNo);
 
+  /**
+   * Insert entry at position pos of the concatenation encoded, whose per-node
+   * offsets are in offsets, and shift the offsets of the nodes after it.
+   */
+  static void
+  insertEntry(std::string& encoded, std::vector<uint32_t>& offsets, size_t pos,
+              const std::string& entry);
+
+  /**
+   * Replace the entry at position pos of the concatenation encoded.
+   */
+  static void
+  replaceEntry(std::string& encoded, std::vector<uint32_t>& offsets, size_t pos,
+               const std::string& entry);
+
+  /**
+   * Find the position in vectorRoot_ of a new node with the given data
+   * prefix and session.
+   */
+  size_t
+  findRootPosition(const std::string& dataPrefix, int sessionNo) const;
+
+  /**
+   * Check if the data prefix of node i is dataPrefix, without copying it out
+   * of the arena.
+   */
+  bool
+  hasDataPrefix(size_t i, const std::string& dataPrefix) const
+  {
+    return prefixLengths_[i] == dataPrefix.size() &&
+      prefixArena_.compare(prefixOffsets_[i], prefixLengths_[i], dataPrefix) == 0;
+  }
 
-  std::vector<std::shared_ptr<ICTVectorState::Node> > digestNode_;
+  // The nodes, sorted by session (as unsigned) and then data prefix, stored
+  // as parallel arrays.
+  std::vector<int32_t> sessions_;
+  std::vector<int32_t> sequences_;
+  std::vector<uint32_t> prefixOffsets_;
+  std::vector<uint32_t> prefixLengths_;
+  // data prefixes of all nodes, appended as nodes are added
+  std::string prefixArena_;
+
+  // The user digests in the order of earlier versions, by data prefix and
+  // then session (as signed), so that peers of any version with the same
+  // state write the same text root. Only the other encodings use node order.
   std::string vectorRoot_;
-  Node::Compare nodeCompare_;
+  // offset of each user digest in vectorRoot_, by position in vectorRoot_
+  std::vector<uint32_t> rootOffsets_;
+  // the node at each position of vectorRoot_
+  std::vector<uint32_t> rootOrder_;
+  // the position in vectorRoot_ of each node
+  std::vector<uint32_t> rootPositions_;
+  std::string binaryRoot_;
+  // offset of each node's entry in binaryRoot_
+  std::vector<uint32_t> binaryOffsets_;
+  // built by getCompressedState, valid if compressedRootVersion_ == version_
+  mutable std::string compressedRoot_;
+  mutable uint64_t compressedRootVersion_ = ~0ULL;
+  uint64_t fingerprint_ = 0;
+  uint64_t version_ = 0;
+  // version at which each node last changed
+  std::vector<uint64_t> nodeVersions_;
+  // session of the node changed at each version from changeLogStart_ to
+  // version_. Old entries are trimmed once the log is longer than the state.
+  std::vector<uint32_t> changeLog_;
+  uint64_t changeLogStart_ = 1;
+  // session id -> index of the first node with that session
+  SessionIndex sessionIndex_;
+  // scratch space for getDiff, one mark per local node
+  mutable std::vector<uint8_t> diffMarks_;
+  // scratch space for getDiff, the parsed remote vector
+  mutable RemoteState remoteScratch_;
 };
 
 /**
@@ -220,38 +550,75 @@ unescape(const std::string& str)
   return result.str();
 }
 
-// class Gzip {
-// public:
-// 	static std::string compress(const std::string& data)
-// 	{
-// 		namespace bio = boost::iostreams;
-//
-// 		std::stringstream compressed;
-// 		std::stringstream origin(data);
-//
-// 		bio::filtering_streambuf<bio::input> out;
-// 		out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_compression)));
-// 		out.push(origin);
-// 		bio::copy(out, compressed);
-//
-// 		return compressed.str();
-// 	}
-//
-// 	static std::string decompress(const std::string& data)
-// 	{
-// 		namespace bio = boost::iostreams;
-//
-// 		std::stringstream compressed(data);
-// 		std::stringstream decompressed;
-//
-// 		bio::filtering_streambuf<bio::input> out;
-// 		out.push(bio::gzip_decompressor());
-// 		out.push(compressed);
-// 		bio::copy(out, decompressed);
-//
-// 		return decompressed.str();
-// 	}
-// };
+/**
+ * Gzip compresses and decompresses with the gzip format of
+ * Boost.Iostreams. The header has no file name or time, so the same input
+ * always gives the same output.
+ */
+class Gzip {
+public:
+  /**
+   * The largest output decompress accepts. Valid states and sync content
+   * come from a single packet of at most 8800 bytes, and do not compress
+   * nearly 8 to 1, while a gzip bomb inflates about 1000 to 1.
+   */
+  static const size_t MAX_DECOMPRESSED_SIZE = 8 * 8800;
+
+  static std::string
+  compress(const std::string& data)
+  {
+    namespace bio = boost::iostreams;
+
+    std::stringstream compressed;
+    std::stringstream origin(data);
+
+    bio::filtering_streambuf<bio::input> out;
+    out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_compression)));
+    out.push(origin);
+    bio::copy(out, compressed);
+
+    return compressed.str();
+  }
+
+  /**
+   * Decompress data from the network. It stops as soon as the output is
+   * larger than maxSize, so a small input cannot make it allocate without
+   * bound.
+   * @throw boost::iostreams::gzip_error if data is not valid gzip.
+   * @throw std::length_error if the output is larger than maxSize.
+   */
+  static std::string
+  decompress(const std::string& data, size_t maxSize)
+  {
+    namespace bio = boost::iostreams;
+
+    std::stringstream compressed(data);
+    std::string decompressed;
+
+    bio::filtering_streambuf<bio::input> out;
+    out.push(bio::gzip_decompressor());
+    out.push(compressed);
+    char buffer[4096];
+    std::streamsize count;
+    while ((count = out.sgetn(buffer, sizeof(buffer))) > 0) {
+      if (decompressed.size() + count > maxSize)
+        throw std::length_error("Gzip: the decompressed data is larger than " +
+                                std::to_string(maxSize) + " bytes");
+      decompressed.append(buffer, count);
+    }
+
+    return decompressed;
+  }
+
+  /**
+   * Check for the gzip magic number at the start of data.
+   */
+  static bool
+  isCompressed(const uint8_t* data, size_t size)
+  {
+    return size >= 2 && data[0] == 0x1f && data[1] == 0x8b;
+  }
+};
 
 }
 
@@ -0,0 +1,201 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#include <stdexcept>
+#include <ndn-cxx/util/logger.hpp>
+#include "ictsync-manager.hpp"
+
+NDN_LOG_INIT(ict.ICTSyncManager);
+
+using namespace std;
+using namespace ndn;
+
+namespace ict {
+
+ICTSyncManager::ICTSyncManager
+  (Face& face, KeyChain& keyChain, const Name& parentPrefix,
+   const RegisterPrefixFailureCallback& onRegisterFailed,
+   std::chrono::milliseconds tick)
+: face_(face), keyChain_(keyChain), parentPrefix_(parentPrefix),
+  scheduler_(new ndn::Scheduler(face.getIoService())), timers_(tick), tick_(tick),
+  isTickScheduled_(false), nextGroupId_(0), hasPendingInterestLimits_(false),
+  pendingInterestCapacity_(0), pendingInterestByteBudget_(0),
+  pendingInterestPolicy_(InterestList::EVICT_OLDEST), unknownGroupInterests_(0)
+{
+  reRegister(onRegisterFailed);
+}
+
+ICTSyncManager::~ICTSyncManager()
+{
+  tickEvent_.cancel();
+  parentPrefixRegId_.unregister();
+  // the groups may outlive the manager in the ICTSync objects of the
+  // application
+  for (auto& group : groups_) {
+    group.second.impl->shutdown();
+    group.second.impl->manager_ = nullptr;
+  }
+}
+
+void
+ICTSyncManager::reRegister(const RegisterPrefixFailureCallback& onRegisterFailed)
+{
+  parentPrefixRegId_ = face_.setInterestFilter
+    (InterestFilter(parentPrefix_),
+     (InterestCallback)bind(&ICTSyncManager::onInterest, this, _1, _2),
+     onRegisterFailed);
+  NDN_LOG_DEBUG("Registered parent prefix " << parentPrefix_);
+}
+
+std::shared_ptr<ICTSync>
+ICTSyncManager::addGroup
+  (const name::Component& group,
+   const ICTSync::OnReceivedSyncState& onReceivedSyncState,
+   const ICTSync::OnInitialized& onInitialized, const Name& applicationDataPrefix,
+   int sessionNo, const Name& certificateName, time::milliseconds syncLifetime,
+   int previousSequenceNumber, bool isDiscovery, bool noData,
+   std::chrono::milliseconds syncUpdateInt)
+{
+  Name broadcastPrefix(parentPrefix_);
+  broadcastPrefix.append(group);
+  if (groups_.count(broadcastPrefix) > 0)
+    throw std::invalid_argument("ICTSyncManager: group " + broadcastPrefix.toUri() +
+                                " is already hosted");
+
+  std::shared_ptr<ICTSync::Impl> impl(new ICTSync::Impl
+    (onReceivedSyncState, onInitialized, applicationDataPrefix, broadcastPrefix,
+     sessionNo, face_, keyChain_, certificateName, syncLifetime,
+     previousSequenceNumber, isDiscovery, noData, syncUpdateInt));
+  uint64_t id = nextGroupId_++;
+  impl->setManager(this, id, scheduler_);
+  impl->setSigningPool(signingPool_);
+  if (hasPendingInterestLimits_)
+    impl->setPendingInterestLimits(pendingInterestCapacity_, pendingInterestByteBudget_,
+                                   pendingInterestPolicy_);
+
+  groups_[broadcastPrefix] = Group{id, impl};
+  groupsById_[id] = impl;
+  // the manager already registered the prefix, so nothing can fail
+  impl->initialize(RegisterPrefixFailureCallback());
+
+  NDN_LOG_DEBUG("Added group " << broadcastPrefix << ", " << groups_.size() << " groups");
+  return std::shared_ptr<ICTSync>(new ICTSync(impl));
+}
+
+bool
+ICTSyncManager::removeGroup(const name::Component& group)
+{
+  Name broadcastPrefix(parentPrefix_);
+  broadcastPrefix.append(group);
+  auto entry = groups_.find(broadcastPrefix);
+  if (entry == groups_.end())
+    return false;
+
+  // its timers in timers_ are ignored when they fire
+  entry->second.impl->shutdown();
+  groupsById_.erase(entry->second.id);
+  groups_.erase(entry);
+  NDN_LOG_DEBUG("Removed group " << broadcastPrefix << ", " << groups_.size() << " groups");
+  return true;
+}
+
+void
+ICTSyncManager::setSigningThreads
+  (size_t threadCount, const SigningPool::KeyChainFactory& makeKeyChain)
+{
+  if (threadCount == 0)
+    signingPool_.reset();
+  else if (makeKeyChain)
+    signingPool_.reset(new SigningPool(threadCount, face_.getIoService(), makeKeyChain));
+  else if (!signingPool_ || signingPool_->getThreadCount() != threadCount)
+    signingPool_.reset(new SigningPool(threadCount, face_.getIoService(),
+                                       SigningPool::getKeyChainFactory(keyChain_)));
+
+  for (auto& group : groups_)
+    group.second.impl->setSigningPool(signingPool_);
+}
+
+void
+ICTSyncManager::setPendingInterestLimits
+  (size_t capacity, size_t byteBudget, InterestList::EvictionPolicy policy)
+{
+  hasPendingInterestLimits_ = true;
+  pendingInterestCapacity_ = capacity;
+  pendingInterestByteBudget_ = byteBudget;
+  pendingInterestPolicy_ = policy;
+
+  for (auto& group : groups_)
+    group.second.impl->setPendingInterestLimits(capacity, byteBudget, policy);
+}
+
+void
+ICTSyncManager::onInterest(const InterestFilter& filter, const Interest& interest)
+{
+  const Name& name = interest.getName();
+  auto group = groups_.end();
+  if (name.size() > parentPrefix_.size())
+    group = groups_.find(name.getPrefix(parentPrefix_.size() + 1));
+
+  if (group == groups_.end()) {
+    ++unknownGroupInterests_;
+    NDN_LOG_DEBUG("No group for interest " << name);
+    return;
+  }
+  group->second.impl->onInterest(filter, interest);
+}
+
+void
+ICTSyncManager::scheduleCheckForUpdate(uint64_t groupId, TimerWheel::Clock::time_point expiry)
+{
+  timers_.schedule(groupId, expiry);
+  if (!isTickScheduled_) {
+    tickEvent_ = scheduler_->schedule(time::milliseconds(tick_.count()),
+                                      bind(&ICTSyncManager::onTick, this));
+    isTickScheduled_ = true;
+  }
+}
+
+void
+ICTSyncManager::onTick()
+{
+  isTickScheduled_ = false;
+  TimerWheel::Clock::time_point now = TimerWheel::Clock::now();
+  expired_.clear();
+  timers_.advance(now, expired_);
+  for (uint64_t id : expired_) {
+    auto group = groupsById_.find(id);
+    // skip the groups already removed
+    if (group == groupsById_.end())
+      continue;
+    // keep the group while checkForUpdate runs, in case it is removed by a
+    // callback of the application
+    std::shared_ptr<ICTSync::Impl> impl = group->second;
+    impl->onCheckForUpdateTimer(now);
+  }
+
+  if (timers_.size() > 0 && !isTickScheduled_) {
+    tickEvent_ = scheduler_->schedule(time::milliseconds(tick_.count()),
+                                      bind(&ICTSyncManager::onTick, this));
+    isTickScheduled_ = true;
+  }
+}
+
+}
@@ -0,0 +1,182 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_SYNC_MANAGER_HPP
+#define NDN_ICT_SYNC_MANAGER_HPP
+
+#include <unordered_map>
+#include <vector>
+#include "ictsync.hpp"
+#include "timer-wheel.hpp"
+
+namespace ict {
+
+/**
+ * An ICTSyncManager hosts many sync groups on one Face. The broadcast prefix
+ * of each group is the parent prefix followed by one group name component.
+ * Instead of each ICTSync registering its own prefix and owning a scheduler,
+ * the manager registers the parent prefix once and dispatches each interest
+ * to its group with one hash lookup. The groups share its scheduler, one
+ * TimerWheel for their checkForUpdate timers, and optionally one SigningPool
+ * and the same pending interest limits.
+ *
+ * Like ICTSync, the manager must be used from the thread of the Face.
+ */
+class ICTSyncManager {
+public:
+  /**
+   * Create an ICTSyncManager and register parentPrefix with the face.
+   * @param tick The resolution of the checkForUpdate timers of the groups.
+   */
+  ICTSyncManager
+    (Face& face, KeyChain& keyChain, const Name& parentPrefix,
+     const RegisterPrefixFailureCallback& onRegisterFailed,
+     std::chrono::milliseconds tick = std::chrono::milliseconds(10));
+
+  /**
+   * Shut down the groups which are still hosted and unregister the parent
+   * prefix.
+   */
+  ~ICTSyncManager();
+
+  /**
+   * Add a group whose broadcast prefix is the parent prefix followed by
+   * group, and start it. See the ICTSync constructor for the other
+   * parameters.
+   * @param syncUpdateInt How often the group checks whether its state
+   * changed since its last sync interest, rounded up to the tick of the
+   * manager. With 0, the default, it checks at every tick, as close as the
+   * shared timers come to the continuous checking of a standalone ICTSync.
+   * Give a positive interval to check less often.
+   * @return The ICTSync of the group. It stays hosted until removeGroup, even
+   * if it is shut down.
+   * @throw std::invalid_argument if the group is already hosted.
+   */
+  std::shared_ptr<ICTSync>
+  addGroup
+    (const name::Component& group,
+     const ICTSync::OnReceivedSyncState& onReceivedSyncState,
+     const ICTSync::OnInitialized& onInitialized, const Name& applicationDataPrefix,
+     int sessionNo, const Name& certificateName, time::milliseconds syncLifetime,
+     int previousSequenceNumber = -1, bool isDiscovery = false, bool noData = false,
+     std::chrono::milliseconds syncUpdateInt = std::chrono::milliseconds(0));
+
+  /**
+   * Shut down a group and stop dispatching interests to it.
+   * @return false if the group is not hosted.
+   */
+  bool
+  removeGroup(const name::Component& group);
+
+  /**
+   * Get the number of groups hosted.
+   */
+  size_t
+  getGroupCount() const { return groups_.size(); }
+
+  /**
+   * Get the number of interests under the parent prefix which were dropped
+   * because they are not for a hosted group.
+   */
+  uint64_t
+  getUnknownGroupInterests() const { return unknownGroupInterests_; }
+
+  /**
+   * Sign the sync Data of all groups, including the ones added later, with
+   * one pool of threadCount threads. See ICTSync::setSigningThreads.
+   */
+  void
+  setSigningThreads(size_t threadCount,
+                    const SigningPool::KeyChainFactory& makeKeyChain = nullptr);
+
+  /**
+   * Set the limits of the pending interest table of each group, including
+   * the ones added later. See ICTSync::setPendingInterestLimits.
+   */
+  void
+  setPendingInterestLimits(size_t capacity, size_t byteBudget,
+                           InterestList::EvictionPolicy policy = InterestList::EVICT_OLDEST);
+
+  /**
+   * Register the parent prefix again, for example if it failed.
+   */
+  void
+  reRegister(const RegisterPrefixFailureCallback& onRegisterFailed);
+
+private:
+  friend class ICTSync::Impl;
+
+  struct Group {
+    uint64_t id;
+    std::shared_ptr<ICTSync::Impl> impl;
+  };
+
+  ICTSyncManager(const ICTSyncManager&) = delete;
+  ICTSyncManager&
+  operator=(const ICTSyncManager&) = delete;
+
+  /**
+   * Dispatch an interest under the parent prefix to its group.
+   */
+  void
+  onInterest(const InterestFilter& filter, const Interest& interest);
+
+  /**
+   * Fire the checkForUpdate timer of a group at expiry. Called by
+   * ICTSync::Impl::scheduleCheckForUpdate.
+   */
+  void
+  scheduleCheckForUpdate(uint64_t groupId, TimerWheel::Clock::time_point expiry);
+
+  /**
+   * Advance the timers and call the groups whose timers fired. The scheduler
+   * event which calls this only runs while there are timers.
+   */
+  void
+  onTick();
+
+  Face& face_;
+  KeyChain& keyChain_;
+  const Name parentPrefix_;
+  std::shared_ptr<ndn::Scheduler> scheduler_;
+  TimerWheel timers_;
+  std::chrono::milliseconds tick_;
+  ndn::scheduler::ScopedEventId tickEvent_;
+  bool isTickScheduled_;
+  // by broadcast prefix, which is the parent prefix and the group component
+  std::unordered_map<Name, Group> groups_;
+  std::unordered_map<uint64_t, std::shared_ptr<ICTSync::Impl>> groupsById_;
+  uint64_t nextGroupId_;
+  std::shared_ptr<SigningPool> signingPool_;
+  // pending interest limits for new groups, if set
+  bool hasPendingInterestLimits_;
+  size_t pendingInterestCapacity_;
+  size_t pendingInterestByteBudget_;
+  InterestList::EvictionPolicy pendingInterestPolicy_;
+  uint64_t unknownGroupInterests_;
+  RegisteredPrefixHandle parentPrefixRegId_;
+  // scratch space for onTick
+  std::vector<uint64_t> expired_;
+};
+
+}
+
+#endif
@@ -24,15 +24,18 @@
  */
 
 
+#include <limits.h>
+#include <set>
 #include <stdexcept>
+#include <cstring>
 #include <ndn-cxx/util/logger.hpp>
-#include <ndn-cxx/security/signing-helpers.hpp>
-#include "sync-state.pb.h"
 //#include "../c/util/time.h"
 #include <ndn-cxx/util/time.hpp>
 #include <ndn-cxx/util/scheduler.hpp>
+#include <ndn-cxx/util/random.hpp>
 #include "ict-vector-state.hpp"
 #include "ictsync.hpp"
+#include "ictsync-manager.hpp"
 
 NDN_LOG_INIT(ict.ICTSync);
 
@@ -50,14 +53,17 @@ ICTSync::Impl::Impl
   applicationDataPrefixUri_(applicationDataPrefix.toUri()),
   applicationBroadcastPrefix_(applicationBroadcastPrefix), sessionNo_(sessionNo),
   face_(face), keyChain_(keyChain), certificateName_(certificateName),
+  signingStrategy_(certificateName),
+  segmentedSnapshots_(SNAPSHOT_CACHE_CAPACITY),
   syncLifetime_(syncLifetime), initialPreviousSequenceNo_(previousSequenceNumber),
-  sequenceNo_(previousSequenceNumber), digestTree_(new ICTVectorState()),
+  sequenceNo_(previousSequenceNumber), publishedSequenceNo_(previousSequenceNumber),
+  digestTree_(new ICTVectorState()),
   pendingInterests_(), enabled_(true), isDiscovery_(isDiscovery), noData_(noData),
-  syncUpdateInterval_(syncUpdateInt)
+  syncUpdateInterval_(syncUpdateInt), diffCache_(DIFF_CACHE_CAPACITY),
+  signedDataCache_(SIGNED_DATA_CACHE_CAPACITY)
 {
   //lastInterestId_ = 0;
   nextInterestTs_ =  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-      if (!scheduler_) scheduler_ = unique_ptr<ndn::Scheduler>(new ndn::Scheduler(face_.getIoService()));
 }
 
 
@@ -65,6 +71,13 @@ ICTSync::Impl::Impl
 void
 ICTSync::Impl::reRegister(const  RegisterPrefixFailureCallback& onRegisterFailed)
 {
+  if (manager_)
+  {
+    // the manager registers the parent prefix, see ICTSyncManager::reRegister
+    NDN_LOG_DEBUG("reRegister: prefix registered by the manager");
+    return;
+  }
+
   // Register the prefix with the face and use our own onInterest
   InterestFilter int_filter(applicationBroadcastPrefix_);
   broadcastPrefixRegId_ = face_.setInterestFilter(int_filter,
@@ -78,13 +91,17 @@ ICTSync::Impl::reRegister(const  RegisterPrefixFailureCallback& onRegisterFailed
 void
 ICTSync::Impl::initialize(const RegisterPrefixFailureCallback& onRegisterFailed)
 {
-  Sync::SyncStateMsg emptyContent;
-  InterestFilter int_filter(applicationBroadcastPrefix_);
+  if (!scheduler_)
+    scheduler_.reset(new ndn::Scheduler(face_.getIoService()));
 
-  // Register the prefix with the face
-  broadcastPrefixRegId_ = face_.setInterestFilter(int_filter,
-						 (InterestCallback)bind(&ICTSync::Impl::onInterest, shared_from_this(), _1, _2),
-						 onRegisterFailed);
+  // Register the prefix with the face, unless the manager dispatches to us
+  if (!manager_)
+  {
+    InterestFilter int_filter(applicationBroadcastPrefix_);
+    broadcastPrefixRegId_ = face_.setInterestFilter(int_filter,
+						   (InterestCallback)bind(&ICTSync::Impl::onInterest, shared_from_this(), _1, _2),
+						   onRegisterFailed);
+  }
 
   Name iname(applicationBroadcastPrefix_);
   iname.append("00");
@@ -101,55 +118,58 @@ ICTSync::Impl::initialize(const RegisterPrefixFailureCallback& onRegisterFailed)
 
   NDN_LOG_DEBUG("initial sync expressed");
   NDN_LOG_DEBUG(interest.getName().toUri());
-  scheduler_->schedule(time::milliseconds(syncUpdateInterval_.count()), bind(&ICTSync::Impl::checkForUpdate, this));
+  scheduleCheckForUpdate();
 }
 
 void
 ICTSync::Impl::shutdown()
 {
   enabled_ = false;
+  publishCoalesceEvent_.cancel();
+  syncInterestEvent_.cancel();
+  outgoingDiscoveryBatches_.clear();
+  signingPool_.reset();
   broadcastPrefixRegId_.unregister();
 }
 
 //Hila: for now - keeping data packets as is - so keeping this method as is
 bool
-ICTSync::Impl::update
-  (const google::protobuf::RepeatedPtrField<Sync::SyncState >& content)
+ICTSync::Impl::update(const SyncContentView& content)
 {
   NDN_LOG_DEBUG("ICTSync::Impl::update");
   int numUpdated = 0;
-  for (size_t i = 0; i < content.size(); ++i)
+  for (const SyncContentView::Entry& entry : content)
   {
-    if (content.Get(i).type() == Sync::SyncState_ActionType_UPDATE)
+    // the view only gives sessions and sequences which fit an int
+    int session = (int)entry.getSession();
+    int sequence = (int)entry.getSequence();
+    if (entry.getAction() == SYNC_ACTION_UPDATE)
     {
       NDN_LOG_DEBUG("Data type: UPDATE");
-      if (digestTree_->update
-          (content.Get(i).name(), content.Get(i).seqno().session(),
-           content.Get(i).seqno().seq()))
+      std::string dataName = entry.getName();
+      if (digestTree_->update(dataName, session, sequence))
       {
         ++numUpdated;
         // if local digest updated
-        if (applicationDataPrefixUri_ == content.Get(i).name())
-          sequenceNo_ = content.Get(i).seqno().seq();
+        if (applicationDataPrefixUri_ == dataName)
+          raiseSequenceNo(sequence);
       }
     }
-    else if (content.Get(i).type() == Sync::SyncState_ActionType_UPDATE_NO_NAME)
+    else if (entry.getAction() == SYNC_ACTION_UPDATE_NO_NAME)
     {
       NDN_LOG_DEBUG("Data type: UPDATE_NO_NAME");
-      std::string dataName = digestTree_->getSessionName( content.Get(i).seqno().session());
+      std::string dataName = digestTree_->getSessionName(session);
       NDN_LOG_DEBUG("UPDATE_NO_NAME for session: "
-                 << content.Get(i).seqno().session()
+                 << session
                  << " with name: " << dataName);
       if(!dataName.empty())
       {
-        if (digestTree_->update
-            (dataName, content.Get(i).seqno().session(),
-             content.Get(i).seqno().seq()))
+        if (digestTree_->update(dataName, session, sequence))
         {
           ++numUpdated;
           // if local digest updated
           if (applicationDataPrefixUri_ == dataName)
-            sequenceNo_ = content.Get(i).seqno().seq();
+            raiseSequenceNo(sequence);
         }
       }
 
@@ -161,6 +181,18 @@ ICTSync::Impl::update
     return false;
 }
 
+void
+ICTSync::Impl::raiseSequenceNo(int sequenceNo)
+{
+  // Never lower the counters: the application may already have taken
+  // sequence numbers which are being coalesced, and the coalescing path
+  // publishes them.
+  if (sequenceNo > publishedSequenceNo_)
+    publishedSequenceNo_ = sequenceNo;
+  if (sequenceNo > sequenceNo_)
+    sequenceNo_ = sequenceNo;
+}
+
 void
 ICTSync::Impl::getProducerPrefixes
   (vector<PrefixAndSessionNo>& prefixes) const
@@ -174,6 +206,17 @@ ICTSync::Impl::getProducerPrefixes
   }
 }
 
+ICTSync::Statistics
+ICTSync::Impl::getStatistics() const
+{
+  Statistics statistics = statistics_;
+  statistics.evictedInterests = pendingInterests_.getEvictionCount();
+  statistics.pendingInterests = pendingInterests_.size();
+  statistics.pendingInterestBytes = pendingInterests_.getMemoryUsage();
+  statistics.signingQueueDepth = signingPool_ ? signingPool_->getQueueDepth() : 0;
+  return statistics;
+}
+
 int
 ICTSync::Impl::getProducerSequenceNo(const std::string& dataPrefix, int sessionNo) const
 {
@@ -189,8 +232,85 @@ void
 ICTSync::Impl::publishNextSequenceNo(const Block& applicationInfo)
 {
   NDN_LOG_DEBUG("publishNextSequenceNo");
-  // update sequence numbers
+  if (publishCoalesceWindow_.count() <= 0)
+  {
+    publishUpTo(sequenceNo_ + 1, applicationInfo);
+    return;
+  }
+
+  // coalesce: only bump the sequence number until the window closes or the
+  // batch is full
   ++sequenceNo_;
+  if (publishMaxBatch_ > 0 && sequenceNo_ - publishedSequenceNo_ >= publishMaxBatch_)
+    commitSequenceNo();
+  else if (sequenceNo_ - publishedSequenceNo_ == 1)
+    publishCoalesceEvent_ =
+      scheduler_->schedule(time::milliseconds(publishCoalesceWindow_.count()),
+                           bind(&ICTSync::Impl::flushCoalescedPublishes, shared_from_this()));
+}
+
+void
+ICTSync::Impl::setPublishCoalescing(std::chrono::milliseconds window, int maxBatch)
+{
+  publishCoalesceWindow_ = window;
+  publishMaxBatch_ = maxBatch;
+  // don't hold back sequence numbers under the old settings
+  if (window.count() <= 0 && sequenceNo_ > publishedSequenceNo_)
+    commitSequenceNo();
+}
+
+void
+ICTSync::Impl::flushCoalescedPublishes()
+{
+  if (!enabled_)
+    return;
+  if (sequenceNo_ > publishedSequenceNo_)
+  {
+    NDN_LOG_DEBUG("flushCoalescedPublishes: publishing " << sequenceNo_ - publishedSequenceNo_);
+    commitSequenceNo();
+  }
+}
+
+// API - publish count new sequenceNos as one batch
+void
+ICTSync::Impl::publishSequenceNumbers(int count, const Block& applicationInfo)
+{
+  NDN_LOG_DEBUG("publishSequenceNumbers " << count);
+  if (count <= 0)
+    return;
+  if (sequenceNo_ > 0 && count > INT_MAX - sequenceNo_)
+  {
+    NDN_LOG_ERROR("publishSequenceNumbers: " << count << " more than " << sequenceNo_
+                  << " overflows the sequence number, not publishing");
+    return;
+  }
+  publishUpTo(sequenceNo_ + count, applicationInfo);
+}
+
+// API - publish up to sequenceNo. Only the latest sequence number is carried
+// in the state, so a batch costs one update, one broadcast and one interest.
+void
+ICTSync::Impl::publishUpTo(int sequenceNo, const Block& applicationInfo)
+{
+  NDN_LOG_DEBUG("publishUpTo " << sequenceNo);
+  if (sequenceNo <= sequenceNo_)
+  {
+    NDN_LOG_DEBUG("publishUpTo: " << sequenceNo << " is not newer than " << sequenceNo_);
+    return;
+  }
+  // update sequence numbers
+  sequenceNo_ = sequenceNo;
+  commitSequenceNo();
+}
+
+void
+ICTSync::Impl::commitSequenceNo()
+{
+  publishCoalesceEvent_.cancel();
+  if (sequenceNo_ > publishedSequenceNo_)
+    statistics_.publishedSequenceNumbers += sequenceNo_ - publishedSequenceNo_;
+  ++statistics_.publishBatches;
+  publishedSequenceNo_ = sequenceNo_;
 
   // update local vector state
   digestTree_->update(applicationDataPrefixUri_, sessionNo_,sequenceNo_);
@@ -228,7 +348,10 @@ ICTSync::Impl::onInterest
   NDN_LOG_DEBUG(interest.getName().toUri());
   std::string iname = interest.getName().toUri();
 
-  if (interest.getName().size() == applicationBroadcastPrefix_.size() + 2)
+  // A sync interest with the state in its parameters also has two
+  // components after the prefix, so look for the DISCOVERY component.
+  if (interest.getName().size() == applicationBroadcastPrefix_.size() + 2 &&
+      interest.getName().get(applicationBroadcastPrefix_.size()) == name::Component("DISCOVERY"))
   {
     if(isDiscovery_)
       processDiscoveryInterest(interest, face_);
@@ -236,13 +359,15 @@ ICTSync::Impl::onInterest
       NDN_LOG_ERROR("Recieved DISCOVERY packet when discovery mode is off. Drop packet");
     return;
   }
-  string syncDigest = interest.getName().get
-    (applicationBroadcastPrefix_.size()).toUri();//EscapedString();
+  const name::Component& stateComponent =
+    interest.getName().get(applicationBroadcastPrefix_.size());
 
-  if (syncDigest == "00")
+  if (stateComponent.type() == tlv::GenericNameComponent &&
+      stateComponent.value_size() == 2 &&
+      memcmp(stateComponent.value(), "00", 2) == 0)
   {
     // a newcomer interest.
-    processNewcomerInterest(interest, syncDigest, face_);
+    processNewcomerInterest(interest, stateComponent.toUri(), face_);
   }
   else
   {
@@ -250,9 +375,19 @@ ICTSync::Impl::onInterest
     // if it can't be satisfied now.
     //pendingInterests_.storeInterest(interest, face);
 
-    if (unescape(syncDigest) != digestTree_->getVectorRoot())
+    // compare the raw component against the local state, no unescape needed
+    if (isLocalState(stateComponent))
+      overhearCoveringState();
+    else
     {
-      processSyncInterest(interest, syncDigest, face_);
+      name::Component remoteState;
+      if (!getStateComponent(interest, remoteState))
+      {
+        NDN_LOG_ERROR("Sync interest without a valid state in its parameters: "
+                      << interest.getName());
+        return;
+      }
+      processSyncInterest(interest, remoteState, face_);
     }
   }
 }
@@ -285,17 +420,26 @@ ICTSync::Impl::onData
       // express an up-to-date interest
       Name name(applicationBroadcastPrefix_);
       name.append(digestTree_->getVectorRoot());
-      sendSyncInterest(syncLifetime_);
+      scheduleSyncInterest();
       //sendSyncInterest(name, syncLifetime_);
       return;
     }
   //END JP ADDED
-  Sync::SyncStateMsg tempContent;
-  tempContent.ParseFromArray(data.getContent().value(), data.getContent().value_size());
+  if (isSnapshotSegment(data.getName()))
+  {
+    // part of a newcomer snapshot too big for one packet
+    onSnapshotSegment(data);
+    return;
+  }
+
+  SyncContentView content;
+  if (!content.parse(data.getContent().value(), data.getContent().value_size()))
+  {
+    NDN_LOG_ERROR("cannot decode the content of " << data.getName());
+    return;
+  }
   //tempContent.ParseFromArray(data.getContent().getBuffer()->get<void>(), data.getContent().getBuffer()->size());
   NDN_LOG_DEBUG("Parsed content");
-  const google::protobuf::RepeatedPtrField<Sync::SyncState >&content = tempContent.ss();
-  NDN_LOG_DEBUG("Got content pointer");
 
   bool isUpdated;
   if(discoveryNameComponent == "DISCOVERY")
@@ -320,58 +464,61 @@ ICTSync::Impl::onData
   }
   // update application only if there are updates
   if (isUpdated)
+    notifyApplication(content);
+  // express an up-to-date interest
+  Name name(applicationBroadcastPrefix_);
+  name.append(digestTree_->getVectorRoot());
+
+  scheduleSyncInterest();
+  //sendSyncInterest(name, syncLifetime_);
+
+}
+
+// Report the UPDATE sync states in content to the application
+void
+ICTSync::Impl::notifyApplication(const SyncContentView& content)
+{
+  // prep updates to be sent to the app
+  vector<SyncState> appUpdates;
+  for (const SyncContentView::Entry& entry : content)
   {
-    // prep updates to be sent to the app
-    vector<SyncState> appUpdates;
-    for (size_t i = 0; i < content.size(); ++i)
+    // Only report UPDATE sync states.
+    if (entry.getAction() == SYNC_ACTION_UPDATE ||
+        entry.getAction() == SYNC_ACTION_UPDATE_NO_NAME )
     {
-      // Only report UPDATE sync states.
-      if (content.Get(i).type() == Sync::SyncState_ActionType_UPDATE ||
-          content.Get(i).type() == Sync::SyncState_ActionType_UPDATE_NO_NAME )
+      Block applicationInfo;
+      if (entry.getApplicationInfoSize() > 0)
+        applicationInfo = Block
+          (entry.getApplicationInfo(), entry.getApplicationInfoSize());
+
+      // get the sequence number from digest tree in case the sequnce
+      // before discovery was greater than the one in the discovery packet
+      int session = (int)entry.getSession();
+      std::string dataName;
+      if (entry.getAction() == SYNC_ACTION_UPDATE_NO_NAME)
       {
-        Block applicationInfo;
-        if (content.Get(i).has_application_info() &&
-            content.Get(i).application_info().size() > 0)
-          applicationInfo = Block
-            ((const uint8_t*)&content.Get(i).application_info()[0],
-             content.Get(i).application_info().size());
-
-        // get the sequence number from digest tree in case the sequnce
-        // before discovery was greater than the one in the discovery packet
-        std::string dataName;
-        if (content.Get(i).type() == Sync::SyncState_ActionType_UPDATE_NO_NAME)
+        dataName = digestTree_->getSessionName(session);
+        if (dataName.empty())
         {
-          dataName = digestTree_->getSessionName(content.Get(i).seqno().session());
-          if (dataName.empty())
-          {
-            NDN_LOG_ERROR("Couldn't get data Name for session " << content.Get(i).seqno().session() << " Can't update App");
-            continue;
-          }
+          NDN_LOG_ERROR("Couldn't get data Name for session " << session << " Can't update App");
+          continue;
         }
-        else
-          dataName = content.Get(i).name();
-
-        int latestSeq = getProducerSequenceNo(dataName,content.Get(i).seqno().session());
-        appUpdates.push_back(SyncState
-          (dataName, content.Get(i).seqno().session(),
-           latestSeq, applicationInfo));
       }
-    }
-    try {
-      onReceivedSyncState_(appUpdates, false); // Hila: changed isRecovery to false
-    } catch (const std::exception& ex) {
-      NDN_LOG_ERROR("ICTSync::Impl::onData: Error in onReceivedSyncState: " << ex.what());
-    } catch (...) {
-      NDN_LOG_ERROR("ICTSync::Impl::onData: Error in onReceivedSyncState.");
+      else
+        dataName = entry.getName();
+
+      int latestSeq = getProducerSequenceNo(dataName, session);
+      appUpdates.push_back(SyncState
+        (dataName, session, latestSeq, applicationInfo));
     }
   }
-  // express an up-to-date interest
-  Name name(applicationBroadcastPrefix_);
-  name.append(digestTree_->getVectorRoot());
-
-  sendSyncInterest(syncLifetime_);
-  //sendSyncInterest(name, syncLifetime_);
-
+  try {
+    onReceivedSyncState_(appUpdates, false); // Hila: changed isRecovery to false
+  } catch (const std::exception& ex) {
+    NDN_LOG_ERROR("ICTSync::Impl::onData: Error in onReceivedSyncState: " << ex.what());
+  } catch (...) {
+    NDN_LOG_ERROR("ICTSync::Impl::onData: Error in onReceivedSyncState.");
+  }
 }
 
 void
@@ -390,71 +537,309 @@ ICTSync::Impl::processNewcomerInterest
     return;
   }
 
-  // go over local syncTree and get the latest seqs
-  Sync::SyncStateMsg tempContent;
-  for (size_t i = 0; i < digestTree_->size(); ++i)
+  const Name& interestName = interest.getName();
+  size_t prefixSize = applicationBroadcastPrefix_.size();
+  if (interestName.size() == prefixSize + 4)
   {
-    Sync::SyncState* content = tempContent.add_ss();
-    content->set_name(digestTree_->get(i).getDataPrefix());
-    content->set_type(Sync::SyncState_ActionType_UPDATE);
-    content->mutable_seqno()->set_seq(digestTree_->get(i).getSequenceNo());
-    content->mutable_seqno()->set_session(digestTree_->get(i).getSessionNo());
+    // a newcomer fetching the rest of a segmented snapshot
+    if (!interestName.get(prefixSize + 1).isNumber() ||
+        !interestName.get(prefixSize + 2).isVersion() ||
+        !interestName.get(prefixSize + 3).isSegment())
+    {
+      NDN_LOG_ERROR("Unknown newcomer interest format " << interestName);
+      return;
+    }
+    // the segments we make in another encoding would not line up with the
+    // ones the newcomer already has
+    if (interestName.get(prefixSize + 1).toNumber() != getSnapshotEncoding())
+    {
+      NDN_LOG_DEBUG("Snapshot encoding of " << interestName << " not used, not answering");
+      return;
+    }
+    std::shared_ptr<const SegmentedSnapshot>* snapshot =
+      segmentedSnapshots_.find(interestName.get(prefixSize + 2).toVersion());
+    if (!snapshot)
+    {
+      NDN_LOG_DEBUG("No snapshot for " << interestName << ", not answering");
+      return;
+    }
+    sendSnapshotSegment(interestName.getPrefix(-1), **snapshot,
+                        interestName.get(prefixSize + 3).toSegment(), face);
+    return;
   }
 
-  if (tempContent.ss_size() != 0)
+  std::shared_ptr<const SegmentedSnapshot> snapshot = getSegmentedSnapshot();
+  if (snapshot->segments.size() > 1)
   {
-    std::shared_ptr<vector<uint8_t> > array(new vector<uint8_t>(tempContent.ByteSize()));
-    tempContent.SerializeToArray(&array->front(), array->size());
-    Data data(interest.getName());
-    data.setContent(Block((const uint8_t*)array->data(),array->size()));//, false));
+    // Too big for one packet. Send the first segment, the newcomer fetches
+    // the others.
+    Name versionedName(applicationBroadcastPrefix_);
+    versionedName.append("00").appendNumber(getSnapshotEncoding())
+      .appendVersion(digestTree_->getFingerprint());
+    sendSnapshotSegment(versionedName, *snapshot, 0, face);
+    return;
+  }
 
-    // Limit the lifetime of replies to interest for "00" since they can be different.
-    data.setFreshnessPeriod(time::milliseconds(500));
-
-    //ndn::security::SigningInfo si;
-    //si.setSigningIdentity(certificateName_);
-    if (certificateName_.empty())
-      keyChain_.sign(data);
-    else   
-      keyChain_.sign(data, security::signingByCertificate(certificateName_));//si);//certificateName_);
-    //keyChain_.sign(data, ndn::security::signingByIdentity(certificateName_));//si);
+  std::shared_ptr<const Data> data = findSignedData(interest.getName());
+  if (data)
+  {
     try {
-      face.put(data);
-      NDN_LOG_DEBUG("send newcomer data back");
+      face.put(*data);
+      NDN_LOG_DEBUG("send cached newcomer data back");
       NDN_LOG_DEBUG(interest.getName().toUri());
     }
     catch (std::exception& e) {
       NDN_LOG_DEBUG(e.what());
     }
+    return;
   }
+
+  if (!snapshot->segments.empty())
+  {
+    // the one segment is the whole state
+    std::shared_ptr<Data> newData(new Data(interest.getName()));
+    newData->setContent(snapshot->segments[0]);
+
+    // Limit the lifetime of replies to interest for "00" since they can be different.
+    newData->setFreshnessPeriod(time::milliseconds(500));
+
+    if (signAndPut(newData, SYNC_DATA_NEWCOMER, face))
+    {
+      NDN_LOG_DEBUG("send newcomer data back");
+      NDN_LOG_DEBUG(interest.getName().toUri());
+    }
+  }
+}
+
+std::shared_ptr<const ICTSync::Impl::SegmentedSnapshot>
+ICTSync::Impl::getSegmentedSnapshot()
+{
+  uint64_t fingerprint = digestTree_->getFingerprint();
+  std::shared_ptr<const SegmentedSnapshot>* cached = segmentedSnapshots_.find(fingerprint);
+  if (cached)
+    return *cached;
+
+  std::shared_ptr<SegmentedSnapshot> snapshot(new SegmentedSnapshot());
+  std::unique_ptr<SyncContentEncoder> segment(new SyncContentEncoder(contentFormat_));
+  auto addSegment = [&] {
+    ConstBufferPtr buffer = segment->encode();
+    if (stateEncoding_ == STATE_ENCODING_COMPRESSED)
+    {
+      std::string compressed = Gzip::compress(std::string(buffer->begin(), buffer->end()));
+      if (compressed.size() < buffer->size())
+        buffer = make_shared<Buffer>(compressed.data(), compressed.size());
+    }
+    snapshot->segments.push_back(buffer);
+    segment.reset(new SyncContentEncoder(contentFormat_));
+  };
+
+  for (size_t i = 0; i < digestTree_->size(); ++i)
+  {
+    const ICTVectorState::Node& node = digestTree_->get(i);
+    segment->add(node.getDataPrefix(), SYNC_ACTION_UPDATE, node.getSessionNo(),
+                 node.getSequenceNo());
+    if (segment->getEncodedSize() > SNAPSHOT_SEGMENT_SIZE && segment->size() > 1)
+    {
+      // the entry starts the next segment
+      segment->removeLast();
+      addSegment();
+      segment->add(node.getDataPrefix(), SYNC_ACTION_UPDATE, node.getSessionNo(),
+                   node.getSequenceNo());
+    }
+  }
+  if (!segment->empty())
+    addSegment();
+
+  ++statistics_.newcomerSnapshotBuilds;
+  NDN_LOG_DEBUG("newcomer snapshot of " << digestTree_->size() << " entries in "
+                << snapshot->segments.size() << " segments");
+  segmentedSnapshots_.insert(fingerprint, snapshot);
+  return snapshot;
+}
+
+void
+ICTSync::Impl::sendSnapshotSegment
+  (const Name& versionedName, const SegmentedSnapshot& snapshot, uint64_t segment,
+   Face& face)
+{
+  if (segment >= snapshot.segments.size())
+  {
+    NDN_LOG_ERROR("No segment " << segment << " in snapshot " << versionedName);
+    return;
+  }
+
+  Name name(versionedName);
+  name.appendSegment(segment);
+  std::shared_ptr<const Data> cached = findSignedData(name);
+  if (cached)
+  {
+    try {
+      face.put(*cached);
+    } catch (std::exception& e) {
+      NDN_LOG_DEBUG(e.what());
+    }
+    return;
+  }
+
+  std::shared_ptr<Data> data(new Data(name));
+  data->setContent(snapshot.segments[segment]);
+  data->setFinalBlock(name::Component::fromSegment(snapshot.segments.size() - 1));
+  // Limit the lifetime like the single packet snapshot, since the first
+  // segment answers "00".
+  data->setFreshnessPeriod(time::milliseconds(500));
+  if (signAndPut(data, SYNC_DATA_NEWCOMER, face))
+    NDN_LOG_DEBUG("sent newcomer snapshot segment " << name);
+}
+
+bool
+ICTSync::Impl::isSnapshotSegment(const Name& name) const
+{
+  size_t prefixSize = applicationBroadcastPrefix_.size();
+  return name.size() == prefixSize + 4 &&
+    name.get(prefixSize) == name::Component("00") &&
+    name.get(prefixSize + 1).isNumber() && name.get(prefixSize + 2).isVersion() &&
+    name.get(prefixSize + 3).isSegment();
+}
+
+void
+ICTSync::Impl::onSnapshotSegment(const Data& data)
+{
+  const Name& name = data.getName();
+  Name versionedName = name.getPrefix(-1);
+  uint64_t segment = name.get(-1).toSegment();
+
+  if (!snapshotFetch_)
+  {
+    // only the first segment, answering "00", starts a fetch
+    if (segment != 0 || digestTree_->getVectorRoot() != "00")
+    {
+      NDN_LOG_DEBUG("Ignoring newcomer snapshot segment " << name);
+      return;
+    }
+    uint64_t segmentCount = 1;
+    if (data.getFinalBlock() && data.getFinalBlock()->isSegment())
+      segmentCount = data.getFinalBlock()->toSegment() + 1;
+
+    snapshotFetch_.reset(new SnapshotFetch());
+    snapshotFetch_->versionedName = versionedName;
+    snapshotFetch_->received.assign(segmentCount, false);
+    NDN_LOG_DEBUG("Fetching newcomer snapshot " << versionedName << " of "
+                  << segmentCount << " segments");
+  }
+  SnapshotFetch& fetch = *snapshotFetch_;
+  if (versionedName != fetch.versionedName || segment >= fetch.received.size() ||
+      fetch.received[segment])
+    return;
+
+  if (segment != 0)
+    --fetch.inFlight;
+  fetch.received[segment] = true;
+  ++fetch.receivedCount;
+
+  // each segment holds whole entries, so apply it right away
+  SyncContentView content;
+  if (!content.parse(data.getContent().value(), data.getContent().value_size()))
+    NDN_LOG_ERROR("cannot decode snapshot segment " << data.getName());
+  else if (update(content))
+    notifyApplication(content);
+
+  if (fetch.receivedCount == fetch.received.size())
+    finishSnapshotFetch();
+  else
+    requestSnapshotSegments();
+}
+
+void
+ICTSync::Impl::requestSnapshotSegments()
+{
+  SnapshotFetch& fetch = *snapshotFetch_;
+  while (fetch.inFlight < SNAPSHOT_FETCH_WINDOW && fetch.nextSegment < fetch.received.size())
+  {
+    uint64_t segment = fetch.nextSegment++;
+    if (fetch.received[segment])
+      continue;
+    expressSnapshotInterest(segment);
+    ++fetch.inFlight;
+  }
+}
+
+void
+ICTSync::Impl::expressSnapshotInterest(uint64_t segment)
+{
+  Name name(snapshotFetch_->versionedName);
+  name.appendSegment(segment);
+  Interest interest(name);
+  interest.setInterestLifetime(time::milliseconds(1000));
+  interest.setCanBePrefix(false);
+  face_.expressInterest
+    (interest, bind(&ICTSync::Impl::onData, shared_from_this(), _1, _2),
+     bind(&ICTSync::Impl::snapshotSegmentNack, shared_from_this(), _1, _2),
+     bind(&ICTSync::Impl::snapshotSegmentTimeout, shared_from_this(), _1));
+  NDN_LOG_TRACE("Snapshot segment interest expressed " << name);
+}
+
+void
+ICTSync::Impl::snapshotSegmentTimeout(const Interest& interest)
+{
+  if (!enabled_ || !snapshotFetch_)
+    return;
+
+  SnapshotFetch& fetch = *snapshotFetch_;
+  const Name& name = interest.getName();
+  uint64_t segment = name.get(-1).toSegment();
+  if (name.getPrefix(-1) != fetch.versionedName || segment >= fetch.received.size() ||
+      fetch.received[segment])
+    return;
+
+  if (++fetch.retries[segment] > SNAPSHOT_SEGMENT_RETRIES)
+  {
+    // Probably no member has this state anymore. Keep what was received,
+    // the sync interests will bring the rest.
+    NDN_LOG_ERROR("Giving up on newcomer snapshot segment " << name);
+    finishSnapshotFetch();
+    return;
+  }
+  expressSnapshotInterest(segment);
+}
+
+void
+ICTSync::Impl::finishSnapshotFetch()
+{
+  NDN_LOG_DEBUG("Newcomer snapshot " << snapshotFetch_->versionedName << ": received "
+                << snapshotFetch_->receivedCount << " of "
+                << snapshotFetch_->received.size() << " segments");
+  snapshotFetch_.reset();
+  finishInitialization();
+  sendSyncInterest(syncLifetime_);
 }
 
 // Process incoming sync interest
 void
 ICTSync::Impl::processSyncInterest
-  (const Interest& interest, const string& syncDigest, Face& face)
+  (const Interest& interest, const name::Component& stateComponent, Face& face)
 {
+  string syncDigest = stateComponent.toUri();
   NDN_LOG_DEBUG("processSyncInterest: " + syncDigest);
 
   // Hila: Get index list of set-difference
-  std::vector<uint8_t> localIndexListToSend;
-  std::vector<std::tuple<uint32_t, uint32_t>> RemoteUpdates;
-  std::vector<std::tuple<uint32_t, uint32_t>> unknownSessions;
-  bool pushDataName;
-
-  // GetDiff==-1 if localIndexListToSend is empty. should still check Remote updates.
-  if(digestTree_->getDiff(syncDigest,
-                          localIndexListToSend,
-                          RemoteUpdates,
-                          unknownSessions,
-                          pushDataName) == -1)
+  uint64_t stateVersion = digestTree_->getVersion();
+  std::shared_ptr<const DiffResult> diff = getDiff(stateComponent, nullptr);
+  const std::vector<uint32_t>& localIndexListToSend = diff->positiveLocalIndexes;
+  const std::vector<std::tuple<uint32_t, uint32_t>>& RemoteUpdates = diff->negativeInLocal;
+  const std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessions = diff->unknownSessions;
+
+  // localIndexListToSend is empty. should still check Remote updates.
+  if(localIndexListToSend.empty())
   {
     // local doesn't have new updates and has nothing to send
-    // save interest for future updates
+    // save interest for future updates, with the parsed state
     //JP Added
     if (!noData_)
     //End JP Added
-      pendingInterests_.storeInterest(interest);//, face);
+    {
+      if (pendingInterests_.storeInterest(interest, stateVersion, diff->remoteState))//, face);
+        ++statistics_.aggregatedInterests;
+    }
     NDN_LOG_DEBUG("Nothing to send. Saving interest for future updates");
   }
   else
@@ -465,7 +850,7 @@ ICTSync::Impl::processSyncInterest
                << ". About to send data to update remote. ");
 
     // send data according to the up-to-date items in local state
-    sendSyncData(syncDigest, localIndexListToSend, face, pushDataName);
+    sendSyncData(interest.getName(), localIndexListToSend, face, diff->pushLocalSessions);
   }
 
   // update local state and application according to the up-to-date items in the remote state
@@ -491,9 +876,16 @@ ICTSync::Impl::processSyncInterest
   }
   else
     NDN_LOG_DEBUG("no unknown session ids");
+
+  // The remote state covers ours if we have nothing newer and it has no
+  // session we do not know: with its updates applied, the two are the same.
+  // Without discovery we only learn an unknown session from Data answering
+  // our own interest, so it must not be suppressed then.
+  if (localIndexListToSend.empty() && unknownSessions.empty())
+    overhearCoveringState();
 }
 
-void ICTSync::Impl::processInterestUpdates(std::vector<std::tuple<uint32_t, uint32_t>>& RemoteUpdates)
+void ICTSync::Impl::processInterestUpdates(const std::vector<std::tuple<uint32_t, uint32_t>>& RemoteUpdates)
 {
   NDN_LOG_DEBUG("processInterestUpdates");
 
@@ -539,11 +931,11 @@ void ICTSync::Impl::processInterestUpdates(std::vector<std::tuple<uint32_t, uint
   Name intName(applicationBroadcastPrefix_);
   intName.append(digestTree_->getVectorRoot());
 
-  sendSyncInterest(syncLifetime_);
+  scheduleSyncInterest();
   //sendSyncInterest(intName, syncLifetime_);
 }
 
-void ICTSync::Impl::processUnknownSessionIds(std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessionIds)
+void ICTSync::Impl::processUnknownSessionIds(const std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessionIds)
 {
   NDN_LOG_DEBUG("processUnknownSessionIds");
 
@@ -553,9 +945,20 @@ void ICTSync::Impl::processUnknownSessionIds(std::vector<std::tuple<uint32_t, ui
     return;
   }
 
-  // send an interest for each unknown session id
+  time::steady_clock::time_point now = time::steady_clock::now();
+  expireAbandonedDiscoveries(now);
+
+  // ask for the unknown sessions not already in flight, in batches
+  std::vector<uint32_t> batch;
   for (const auto &unknownSession : unknownSessionIds)
   {
+    auto abandoned = abandonedDiscoverySessions_.find(std::get<0>(unknownSession));
+    if (abandoned != abandonedDiscoverySessions_.end() && now < abandoned->second.holdOffUntil)
+    {
+      NDN_LOG_TRACE("Discovery for session " << std::get<0>(unknownSession) << " is held off");
+      continue;
+    }
+
     // first, check if an interest for this session is already in flight
     auto search = outgoingDiscoveryInterests_.find(std::get<0>(unknownSession));
     if (search != outgoingDiscoveryInterests_.end())
@@ -571,24 +974,118 @@ void ICTSync::Impl::processUnknownSessionIds(std::vector<std::tuple<uint32_t, ui
     }
 
     // no discovery interest for this session is in flight
-    Name iname = applicationBroadcastPrefix_;
-    iname.append("DISCOVERY").append(std::to_string(std::get<0>(unknownSession)).c_str());
-    Interest interest(iname);
-    //interest.getName().append("DISCOVERY");
-    //JP changed to make human readable in wireshark
-    //interest.getName().append(std::to_string(std::get<0>(unknownSession)).c_str());//Name::Component::fromNumber(std::get<0>(unknownSession)));
-    interest.setInterestLifetime(syncLifetime_);
-    face_.expressInterest
-      (interest, bind(&ICTSync::Impl::onData, shared_from_this(), _1, _2),
-       bind(&ICTSync::Impl::discoveryNack, shared_from_this(), _1, _2),
-       bind(&ICTSync::Impl::discoveryTimeout, shared_from_this(), _1));
-
     outgoingDiscoveryInterests_[std::get<0>(unknownSession)] = std::get<1>(unknownSession);
+    batch.push_back(std::get<0>(unknownSession));
+    if (batch.size() == DISCOVERY_BATCH_SIZE)
+    {
+      expressDiscoveryInterest(batch);
+      batch.clear();
+    }
+  }
+  if (!batch.empty())
+    expressDiscoveryInterest(batch);
+}
 
-    NDN_LOG_DEBUG("Discovery Interest for session " << std::get<0>(unknownSession) << " expressed");
-    NDN_LOG_DEBUG(interest.getName().toUri());
+void
+ICTSync::Impl::expressDiscoveryInterest(const std::vector<uint32_t>& sessions)
+{
+  //JP changed to make human readable in wireshark
+  std::string sessionList;
+  for (uint32_t session : sessions)
+  {
+    if (!sessionList.empty())
+      sessionList += '.';
+    sessionList += std::to_string(session);
+  }
+
+  Name iname = applicationBroadcastPrefix_;
+  iname.append("DISCOVERY").append(sessionList);
+  DiscoveryBatch& batch = outgoingDiscoveryBatches_[iname];
+  batch.sessions = sessions;
+  batch.retries = 0;
+  ++statistics_.discoveryInterests;
+  statistics_.discoveryRequestedSessions += sessions.size();
+
+  sendDiscoveryInterest(iname);
+  NDN_LOG_DEBUG("Discovery Interest for " << sessions.size() << " sessions expressed");
+}
+
+void
+ICTSync::Impl::sendDiscoveryInterest(const Name& name)
+{
+  if (!enabled_ || outgoingDiscoveryBatches_.find(name) == outgoingDiscoveryBatches_.end())
+    return;
+
+  Interest interest(name);
+  interest.setInterestLifetime(syncLifetime_);
+  face_.expressInterest
+    (interest, bind(&ICTSync::Impl::onData, shared_from_this(), _1, _2),
+     bind(&ICTSync::Impl::discoveryNack, shared_from_this(), _1, _2),
+     bind(&ICTSync::Impl::discoveryTimeout, shared_from_this(), _1));
+  NDN_LOG_DEBUG(interest.getName().toUri());
+}
+
+void
+ICTSync::Impl::abandonDiscoveryBatch(const Name& name)
+{
+  auto batch = outgoingDiscoveryBatches_.find(name);
+  if (batch == outgoingDiscoveryBatches_.end())
+    return;
+
+  time::steady_clock::time_point now = time::steady_clock::now();
+  for (uint32_t session : batch->second.sessions)
+  {
+    outgoingDiscoveryInterests_.erase(session);
+    AbandonedSession& abandoned = abandonedDiscoverySessions_[session];
+    int holdOff = DISCOVERY_HOLDOFF_MAX_MS;
+    if (abandoned.abandonments < 16)
+      holdOff = std::min(DISCOVERY_HOLDOFF_INITIAL_MS << abandoned.abandonments,
+                         DISCOVERY_HOLDOFF_MAX_MS);
+    ++abandoned.abandonments;
+    abandoned.holdOffUntil = now + time::milliseconds(holdOff);
+    NDN_LOG_DEBUG("Giving up on discovery of session " << session << " for " << holdOff << " ms");
   }
+  statistics_.abandonedDiscoverySessions += batch->second.sessions.size();
+  outgoingDiscoveryBatches_.erase(batch);
+}
 
+void
+ICTSync::Impl::expireAbandonedDiscoveries(time::steady_clock::time_point now)
+{
+  for (auto abandoned = abandonedDiscoverySessions_.begin();
+       abandoned != abandonedDiscoverySessions_.end(); )
+  {
+    if (digestTree_->find(abandoned->first) >= 0 ||
+        abandoned->second.holdOffUntil + time::milliseconds(DISCOVERY_HOLDOFF_MAX_MS) < now)
+      abandoned = abandonedDiscoverySessions_.erase(abandoned);
+    else
+      ++abandoned;
+  }
+}
+
+bool
+ICTSync::Impl::parseDiscoverySessions
+  (const name::Component& component, std::vector<uint32_t>& sessions)
+{
+  // parse the raw value rather than going through toUri
+  const char* position = (const char*)component.value();
+  const char* end = position + component.value_size();
+  sessions.clear();
+  while (position < end)
+  {
+    uint64_t session = 0;
+    const char* start = position;
+    while (position < end && *position >= '0' && *position <= '9' && position - start < 10)
+      session = session * 10 + (*position++ - '0');
+    if (position == start || session > 0xFFFFFFFF ||
+        sessions.size() == DISCOVERY_BATCH_SIZE)
+      return false;
+    sessions.push_back((uint32_t)session);
+
+    if (position < end && *position++ != '.')
+      return false;
+  }
+  return !sessions.empty();
 }
 
 void
@@ -611,55 +1108,67 @@ ICTSync::Impl::processDiscoveryInterest
     return;
   }
 
-  // Get the requetsed session id
-  //JP change to get sessionID readable in wireshark
-  uint32_t sessionId = (uint32_t)std::stoi(interest.getName().
-					   get(applicationBroadcastPrefix_.size() + 1).toUri());//EscapedString()); //Number();
-  //uint32_t sessionId = ::atoi(sessionIdStr.c_str());
+  // Get the requested session ids
+  std::vector<uint32_t> sessions;
+  if (!parseDiscoverySessions(interest.getName().get(applicationBroadcastPrefix_.size() + 1),
+                              sessions))
+  {
+    NDN_LOG_ERROR("Bad session list in DISCOVERY interest " << interest.getName());
+    return;
+  }
 
-  NDN_LOG_DEBUG("received DISCOVERY for session " << sessionId );
+  NDN_LOG_DEBUG("received DISCOVERY for " << sessions.size() << " sessions");
 
-  // Check if session id is known
-  int sessionIndex = digestTree_->find(sessionId);
-  if(sessionIndex < 0)
+  std::shared_ptr<const Data> data = findSignedData(interest.getName());
+  if (data)
   {
-    NDN_LOG_ERROR("Unknown session " << sessionId << " in DISCOVERY interest. Interest dropped (not necessarily an error)");
+    try {
+      face.put(*data);
+      NDN_LOG_DEBUG("Cached Sync Data sent");
+      NDN_LOG_DEBUG(data->getName().toUri());
+    } catch (std::exception& e) {
+      NDN_LOG_DEBUG(e.what());
+    }
     return;
   }
-  int seq = digestTree_->get(sessionIndex).getSequenceNo();
-  string dataName = digestTree_->get(sessionIndex).getDataPrefix();
 
-  // respond to interest with data name and latest known sequence number
-  NDN_LOG_TRACE("Session ID found, about to send DISCOVERY data " <<
-             "sessionId: " << sessionId  <<
-             ", data name: " << dataName <<
-             ", seq number " << seq);
+  // create data packet with the data name and latest known sequence number
+  // of each known session. The requester asks again for the sessions which
+  // do not fit.
+  SyncContentEncoder encoder(contentFormat_);
+  for (uint32_t sessionId : sessions)
+  {
+    if (encoder.getEncodedSize() >= DISCOVERY_CONTENT_SIZE)
+      break;
 
-  // create data packet
-  Sync::SyncStateMsg tempContent;
-  Sync::SyncState* content = tempContent.add_ss();
-  content->set_name(dataName);
-  content->set_type(Sync::SyncState_ActionType_UPDATE);
-  content->mutable_seqno()->set_seq(seq);
-  content->mutable_seqno()->set_session(sessionId);
-
-  std::shared_ptr<vector<uint8_t> > array(new vector<uint8_t>(tempContent.ByteSize()));
-  tempContent.SerializeToArray(&array->front(), array->size());
-  Data data(interest.getName());
-  data.setContent(Block((const uint8_t*)array->data(), array->size()));//, false));
-  //ndn::security::SigningInfo si;
-  //si.setSigningIdentity(certificateName_);
-    if (certificateName_.empty())
-      keyChain_.sign(data);
-    else   
-      keyChain_.sign(data, security::signingByCertificate(certificateName_));//si);//certificateName_);
-    //keyChain_.sign(data, security::signingByIdentity(certificateName_));//si);//certificateName_);
-  try {
-    face.put(data);
+    // Check if session id is known
+    int sessionIndex = digestTree_->find(sessionId);
+    if(sessionIndex < 0)
+    {
+      NDN_LOG_DEBUG("Unknown session " << sessionId << " in DISCOVERY interest (not necessarily an error)");
+      continue;
+    }
+    int seq = digestTree_->get(sessionIndex).getSequenceNo();
+    string dataName = digestTree_->get(sessionIndex).getDataPrefix();
+
+    NDN_LOG_TRACE("Session ID found, adding to DISCOVERY data " <<
+               "sessionId: " << sessionId  <<
+               ", data name: " << dataName <<
+               ", seq number " << seq);
+    encoder.add(dataName, SYNC_ACTION_UPDATE, sessionId, seq);
+  }
+  if (encoder.empty())
+  {
+    NDN_LOG_ERROR("No known session in DISCOVERY interest. Interest dropped (not necessarily an error)");
+    return;
+  }
+
+  std::shared_ptr<Data> newData(new Data(interest.getName()));
+  newData->setContent(makeSyncContent(encoder));
+  if (signAndPut(newData, SYNC_DATA_DISCOVERY, face))
+  {
     NDN_LOG_DEBUG("Sync Data sent");
-    NDN_LOG_DEBUG(data.getName().toUri());
-  } catch (std::exception& e) {
-    NDN_LOG_DEBUG(e.what());
+    NDN_LOG_DEBUG(interest.getName().toUri());
   }
 }
 
@@ -680,91 +1189,348 @@ ICTSync::Impl::discoveryTimeout(const Interest& interest)
     NDN_LOG_ERROR("Unknown interest format");
     return;
   }
-  // Get the requetsed session id
-  uint32_t sessionId = (uint32_t)std::stoi(interest.getName().
-					   get(applicationBroadcastPrefix_.size() + 1).toUri());//EscapedString());
+  auto batch = outgoingDiscoveryBatches_.find(interest.getName());
+  if (batch == outgoingDiscoveryBatches_.end())
+    // answered by an earlier copy of the interest
+    return;
 
-  NDN_LOG_DEBUG("DISCOVERY Timeout for session " << sessionId );
+  NDN_LOG_DEBUG("DISCOVERY Timeout for " << interest.getName());
 
-  Interest interest2(interest.getName());
-  interest2.setInterestLifetime(syncLifetime_);
+  DiscoveryBatch& retry = batch->second;
+  if (retry.retries >= DISCOVERY_RETRIES)
+  {
+    // the sessions have probably left the sync group
+    abandonDiscoveryBatch(interest.getName());
+    return;
+  }
 
-  //JP change to resend but need to figure out what to do if never get an answer
-  face_.expressInterest
-    (interest2, bind(&ICTSync::Impl::onData, shared_from_this(), _1, _2),
-     bind(&ICTSync::Impl::discoveryNack, shared_from_this(), _1, _2),
-     bind(&ICTSync::Impl::discoveryTimeout, shared_from_this(), _1));
-  // remove from outgoingDiscoveryInterests_
-  //auto search = outgoingDiscoveryInterests_.find(sessionId);
-  //if(search != outgoingDiscoveryInterests_.end())
-  //    outgoingDiscoveryInterests_.erase(search);
-  //else
-  //  NDN_LOG_ERROR("DISCOVERY session timed out but it's not in outgoing discovery interest list" );
+  // wait a random part of the backoff so that the nodes which saw the same
+  // unknown sessions do not retry together
+  int backoff = std::min(DISCOVERY_BACKOFF_INITIAL_MS << retry.retries, DISCOVERY_BACKOFF_MAX_MS);
+  time::milliseconds delay(random::generateWord32() % (backoff + 1));
+  ++retry.retries;
+  ++statistics_.discoveryRetries;
+  retry.retryEvent = scheduler_->schedule
+    (delay, bind(&ICTSync::Impl::sendDiscoveryInterest, shared_from_this(), interest.getName()));
+}
 
+void
+ICTSync::Impl::parseState
+  (const name::Component& stateComponent, ICTVectorState::RemoteState& remote)
+{
+  StateEncoding encoding = STATE_ENCODING_TEXT;
+  if (stateComponent.type() == ICTVectorState::BINARY_STATE_COMPONENT_TYPE)
+    encoding = STATE_ENCODING_BINARY;
+  else if (stateComponent.type() == ICTVectorState::COMPRESSED_STATE_COMPONENT_TYPE)
+    encoding = STATE_ENCODING_COMPRESSED;
+  ICTVectorState::parseState(stateComponent.value(), stateComponent.value_size(),
+                             encoding, remote);
+}
+
+/**
+ * Get a 64-bit hash of the type and value of a state name component, reading
+ * the value 8 bytes at a time.
+ */
+static uint64_t
+getStateFingerprint(const name::Component& component)
+{
+  const uint8_t* value = component.value();
+  size_t size = component.value_size();
+  uint64_t hash = 0xcbf29ce484222325ULL ^ component.type();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, value + i, 8);
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 32;
+  }
+  // the value is null when the component is empty
+  uint64_t tail = 0;
+  if (size > i)
+    memcpy(&tail, value + i, size - i);
+  hash = (hash ^ tail ^ size) * 0x9E3779B97F4A7C15ULL;
+  hash ^= hash >> 32;
+  return ICTVectorState::getEntryFingerprint((uint32_t)(hash >> 32), (uint32_t)hash);
+}
+
+std::shared_ptr<const ICTSync::Impl::DiffResult>
+ICTSync::Impl::getDiff
+  (const name::Component& stateComponent,
+   const InterestList::PendingInterest* pending)
+{
+  DiffCacheKey key = { getStateFingerprint(stateComponent), digestTree_->getVersion() };
+  std::shared_ptr<DiffResult>* cached = diffCache_.find(key);
+  if (cached && (*cached)->stateComponent == stateComponent &&
+      (pending || (*cached)->hasRemoteUpdates))
+  {
+    ++statistics_.diffCacheHits;
+    return *cached;
+  }
+  ++statistics_.diffCacheMisses;
+
+  std::shared_ptr<DiffResult> diff(new DiffResult());
+  diff->stateComponent = stateComponent;
+  if (pending && pending->getRemoteState())
+  {
+    // The pending interest had nothing newer than it when stored, so only
+    // the entries changed since then need to be compared.
+    diff->remoteState = pending->getRemoteState();
+    digestTree_->getDiffSince(*diff->remoteState, pending->getStateVersion(),
+                              diff->positiveLocalIndexes, diff->pushLocalSessions);
+  }
+  else
+  {
+    std::shared_ptr<ICTVectorState::RemoteState> remoteState
+      (new ICTVectorState::RemoteState());
+    parseState(stateComponent, *remoteState);
+    diff->remoteState = remoteState;
+    digestTree_->getDiff(*remoteState, diff->positiveLocalIndexes, diff->negativeInLocal,
+                         diff->unknownSessions, diff->pushLocalSessions);
+    diff->hasRemoteUpdates = true;
+  }
+
+  diffCache_.insert(key, diff);
+  return diff;
+}
+
+std::shared_ptr<const Data>
+ICTSync::Impl::findSignedData(const Name& name)
+{
+  if (signedDataVersion_ != digestTree_->getVersion())
+  {
+    // the cached Data describe an older state
+    signedDataCache_.clear();
+    signedDataVersion_ = digestTree_->getVersion();
+  }
+
+  std::shared_ptr<const Data>* cached = signedDataCache_.find(name);
+  if (cached)
+  {
+    ++statistics_.signedDataCacheHits;
+    return *cached;
+  }
+  ++statistics_.signedDataCacheMisses;
+  return nullptr;
+}
+
+bool
+ICTSync::Impl::signAndPut(const std::shared_ptr<Data>& data, SyncDataKind kind, Face& face)
+{
+  uint64_t version = digestTree_->getVersion();
+  uint64_t generation = signedDataGeneration_;
+  if (signingPool_)
+  {
+    // sign on a worker thread, then put from the io thread
+    std::weak_ptr<Impl> self = shared_from_this();
+    signingPool_->sign(data, signingStrategy_.getSigningInfo(kind),
+                       [self, version, generation, &face] (const std::shared_ptr<Data>& signedData) {
+                         std::shared_ptr<Impl> impl = self.lock();
+                         if (impl && impl->enabled_)
+                           impl->putSignedData(signedData, version, generation, face);
+                       });
+    return true;
+  }
+
+  signingStrategy_.sign(keyChain_, *data, kind);
+  return putSignedData(data, version, generation, face);
+}
+
+bool
+ICTSync::Impl::putSignedData(const std::shared_ptr<const Data>& data, uint64_t version,
+                             uint64_t generation, Face& face)
+{
+  // only cache Data which still describe the local state, and were signed
+  // and encoded with the current settings
+  if (signedDataVersion_ == version && digestTree_->getVersion() == version &&
+      signedDataGeneration_ == generation)
+    signedDataCache_.insert(data->getName(), data);
+
+  try {
+    face.put(*data);
+    return true;
+  } catch (std::exception& e) {
+    NDN_LOG_DEBUG(e.what());
+    return false;
+  }
+}
+
+void
+ICTSync::Impl::setSigningThreads
+  (size_t threadCount, const SigningPool::KeyChainFactory& makeKeyChain)
+{
+  if (threadCount == 0)
+    signingPool_.reset();
+  else if (makeKeyChain)
+    signingPool_.reset(new SigningPool(threadCount, face_.getIoService(), makeKeyChain));
+  else if (!signingPool_ || signingPool_->getThreadCount() != threadCount)
+    signingPool_.reset(new SigningPool(threadCount, face_.getIoService(),
+                                       SigningPool::getKeyChainFactory(keyChain_)));
+}
+
+bool
+ICTSync::Impl::isLocalState(const name::Component& stateComponent) const
+{
+  if (stateComponent.type() == ICTVectorState::STATE_DIGEST_COMPONENT_TYPE)
+  {
+    name::Component digest = makeStateDigestComponent();
+    return stateComponent.value_size() == digest.value_size() &&
+      memcmp(stateComponent.value(), digest.value(), digest.value_size()) == 0;
+  }
+  if (stateComponent.type() == ICTVectorState::BINARY_STATE_COMPONENT_TYPE)
+    return digestTree_->isBinaryState(stateComponent.value(), stateComponent.value_size());
+  if (stateComponent.type() == ICTVectorState::COMPRESSED_STATE_COMPONENT_TYPE)
+    return digestTree_->isCompressedState(stateComponent.value(), stateComponent.value_size());
+  return digestTree_->isVectorRoot(stateComponent.value(), stateComponent.value_size());
+}
+
+Name
+ICTSync::Impl::makeSyncInterestName() const
+{
+  Name name(applicationBroadcastPrefix_);
+  name::Component state = makeStateComponent();
+  if (parametersThreshold_ > 0 && state.value_size() > parametersThreshold_)
+    name.append(makeStateDigestComponent());
+  else
+    name.append(state);
+  return name;
+}
+
+name::Component
+ICTSync::Impl::makeStateComponent() const
+{
+  if (stateEncoding_ == STATE_ENCODING_BINARY && digestTree_->size() > 0)
+  {
+    const std::string& state = digestTree_->getBinaryState();
+    return name::Component(ICTVectorState::BINARY_STATE_COMPONENT_TYPE,
+                           (const uint8_t*)state.data(), state.size());
+  }
+  if (stateEncoding_ == STATE_ENCODING_COMPRESSED && digestTree_->size() > 0)
+  {
+    const std::string& state = digestTree_->getCompressedState();
+    return name::Component(ICTVectorState::COMPRESSED_STATE_COMPONENT_TYPE,
+                           (const uint8_t*)state.data(), state.size());
+  }
+  return name::Component(digestTree_->getVectorRoot());
+}
+
+Block
+ICTSync::Impl::makeSyncContent(const SyncContentEncoder& encoder) const
+{
+  ConstBufferPtr content = encoder.encode();
+  if (stateEncoding_ == STATE_ENCODING_COMPRESSED)
+  {
+    std::string compressed = Gzip::compress(std::string(content->begin(), content->end()));
+    if (compressed.size() < content->size())
+      content = make_shared<Buffer>(compressed.data(), compressed.size());
+  }
+  if (encoder.getFormat() == CONTENT_FORMAT_TLV || Gzip::isCompressed(content->data(), content->size()))
+    return Block(tlv::Content, content);
+  return Block(content->data(), content->size());//, false));
+}
+
+name::Component
+ICTSync::Impl::makeStateDigestComponent() const
+{
+  uint64_t fingerprint = digestTree_->getFingerprint();
+  uint32_t size = digestTree_->size();
+  uint8_t digest[12];
+  for (int i = 0; i < 8; ++i)
+    digest[i] = (uint8_t)(fingerprint >> (56 - 8 * i));
+  for (int i = 0; i < 4; ++i)
+    digest[8 + i] = (uint8_t)(size >> (24 - 8 * i));
+  return name::Component(ICTVectorState::STATE_DIGEST_COMPONENT_TYPE, digest, sizeof(digest));
+}
+
+bool
+ICTSync::Impl::getStateComponent
+  (const Interest& interest, name::Component& stateComponent) const
+{
+  const name::Component& component =
+    interest.getName().get(applicationBroadcastPrefix_.size());
+  if (component.type() != ICTVectorState::STATE_DIGEST_COMPONENT_TYPE)
+  {
+    stateComponent = component;
+    return true;
+  }
+
+  // the parameters hold the state name component
+  if (!interest.hasApplicationParameters() || !interest.isParametersDigestValid())
+    return false;
+  try {
+    Block parameters = interest.getApplicationParameters();
+    parameters.parse();
+    if (parameters.elements().size() != 1)
+      return false;
+    stateComponent = name::Component(parameters.elements().front());
+  }
+  catch (const std::exception& e) {
+    NDN_LOG_DEBUG("Bad sync interest parameters: " << e.what());
+    return false;
+  }
+  return true;
 }
 
 bool
 ICTSync::Impl::sendSyncData
-  (const string& syncDigest, std::vector<uint8_t>& indexListToSend, Face& face, bool sendName)
+  (const Name& dataName, const std::vector<uint32_t>& indexListToSend, Face& face, bool sendName)
 {
   //JP Added
   if (noData_)
     {
-      NDN_LOG_DEBUG("sendSyncData noData_ set not sending name: " << syncDigest);
+      NDN_LOG_DEBUG("sendSyncData noData_ set not sending name: " << dataName);
       return true;
     }
   //End JP Added
-  NDN_LOG_DEBUG("sendSyncData with name: " << syncDigest);
+  NDN_LOG_DEBUG("sendSyncData with name: " << dataName);
+
+  // The Data for a name only depends on the local state, so another peer
+  // with the same state already got this one.
+  std::shared_ptr<const Data> cached = findSignedData(dataName);
+  if (cached)
+  {
+    try {
+      face.put(*cached);
+      NDN_LOG_DEBUG("Cached Sync Data sent");
+      NDN_LOG_DEBUG(dataName.toUri());
+      return true;
+    } catch (std::exception& e) {
+      NDN_LOG_DEBUG(e.what());
+      return false;
+    }
+  }
 
   // create data packet
-  Sync::SyncStateMsg tempContent;
+  SyncContentEncoder encoder(contentFormat_);
   for (size_t i = 0; i < indexListToSend.size(); ++i)
   {
-    Sync::SyncState* content = tempContent.add_ss();
     // If in discovery mode, then no need to send the name unless specifically requested.
     if (!isDiscovery_ || sendName)
-    {
-      content->set_name(digestTree_->get(indexListToSend[i]).getDataPrefix());
-      content->set_type(Sync::SyncState_ActionType_UPDATE);
-    }
+      encoder.add(digestTree_->get(indexListToSend[i]).getDataPrefix(), SYNC_ACTION_UPDATE,
+                  digestTree_->get(indexListToSend[i]).getSessionNo(),
+                  digestTree_->get(indexListToSend[i]).getSequenceNo());
     else
-    {
-      content->set_type(Sync::SyncState_ActionType_UPDATE_NO_NAME);
-    }
-
-    content->mutable_seqno()->set_seq(digestTree_->get(indexListToSend[i]).getSequenceNo());
-    content->mutable_seqno()->set_session(digestTree_->get(indexListToSend[i]).getSessionNo());
+      encoder.add("", SYNC_ACTION_UPDATE_NO_NAME,
+                  digestTree_->get(indexListToSend[i]).getSessionNo(),
+                  digestTree_->get(indexListToSend[i]).getSequenceNo());
 
     NDN_LOG_DEBUG("Sending diff. Session: " << digestTree_->get(indexListToSend[i]).getSessionNo()
                << " Sequence: " << digestTree_->get(indexListToSend[i]).getSequenceNo());
   }
 
   bool sent = false;
-  if (tempContent.ss_size() != 0)
+  if (!encoder.empty())
   {
-    Name name(applicationBroadcastPrefix_);
-    name.append(unescape(syncDigest));
-    std::shared_ptr<vector<uint8_t> > array(new vector<uint8_t>(tempContent.ByteSize()));
-    tempContent.SerializeToArray(&array->front(), array->size());
-    Data data(name);
+    const Name& name = dataName;
+    std::shared_ptr<Data> data(new Data(name));
   //JP ADDED
     if (!isDiscovery_)
   //END JP ADDED
-      data.setContent(Block((const uint8_t*)array->data(), array->size()));//, false));
-    //ndn::security::SigningInfo si;
-    //si.setSigningIdentity(certificateName_);
-    if (certificateName_.empty())
-      keyChain_.sign(data);//si);//certificateName_);
-    else
-      keyChain_.sign(data, security::signingByCertificate(certificateName_));//si);//certificateName_);
-    //keyChain_.sign(data, security::signingByIdentity(certificateName_));//si);//certificateName_);
-    try {
-      face.put(data);
-      sent = true;
+      data->setContent(makeSyncContent(encoder));
+    sent = signAndPut(data, SYNC_DATA_SYNC, face);
+    if (sent)
+    {
       NDN_LOG_DEBUG("Sync Data sent");
       NDN_LOG_DEBUG(name.toUri());
-    } catch (std::exception& e) {
-      NDN_LOG_DEBUG(e.what());
     }
   }
 
@@ -783,8 +1549,8 @@ ICTSync::Impl::syncTimeout(const Interest& interest)
 
    NDN_LOG_DEBUG("Sync Interest time out.");
    NDN_LOG_DEBUG("Timed out Interest name: " + interest.getName().toUri());
-  string component = interest.getName().get
-    (applicationBroadcastPrefix_.size()).toUri();//EscapedString();
+  const name::Component& component =
+    interest.getName().get(applicationBroadcastPrefix_.size());
 
   // if same state, retry the same interest.
   // Otherwise, assume someone else expressed the new interest
@@ -792,11 +1558,13 @@ ICTSync::Impl::syncTimeout(const Interest& interest)
   // after fix, should think if this condition is still correct
 
   //JP PROBLEM
-  NDN_LOG_DEBUG("Timeout Interest: " << unescape(component)
+  NDN_LOG_DEBUG("Timeout Interest: " << component.toUri()
             << " local state: "  << digestTree_->getVectorRoot());
-  if (unescape(component) == digestTree_->getVectorRoot())
+  if (isLocalState(component))
   {
-    Name name(interest.getName());
+    // the same state, so makeSyncInterestName gives the same name without
+    // any parameters digest
+    Name name = makeSyncInterestName();
     //Name name(applicationBroadcastPrefix_);
     //name.append(digestTree_->getVectorRoot());
     //sendSyncInterest(syncLifetime_);
@@ -806,7 +1574,7 @@ ICTSync::Impl::syncTimeout(const Interest& interest)
   else
     {
       string iname = interest.getName().toUri();
-      NDN_LOG_DEBUG("Timeout Interest: don't recognize" << unescape(component)
+      NDN_LOG_DEBUG("Timeout Interest: don't recognize" << component.toUri()
 		    << " local state: "  << digestTree_->getVectorRoot());
       //should check if this is my interest although it's unclear why we'd time out on someone else's
       //Name name(applicationBroadcastPrefix_);
@@ -817,42 +1585,77 @@ ICTSync::Impl::syncTimeout(const Interest& interest)
 // received discovery sync data with
 bool
 ICTSync::Impl::onDiscoveryData
-    (const Interest& interest,
-     const google::protobuf::RepeatedPtrField<Sync::SyncState >& content)
+    (const Interest& interest, const SyncContentView& content)
 {
   if(!isDiscovery_)
   {
     NDN_LOG_ERROR("received discovery data but discovery mode is off. Quit");
     return false;
   }
-  bool isUpdated = false;
-  // Get the requetsed session id
-  uint32_t sessionId = std::stoi(interest.getName().
-    get(applicationBroadcastPrefix_.size() + 1).toUri()); //Number();
+  auto batch = outgoingDiscoveryBatches_.find(interest.getName());
+  if (batch == outgoingDiscoveryBatches_.end())
+  {
+    NDN_LOG_DEBUG("DISCOVERY data for a batch no longer in flight " << interest.getName());
+    return false;
+  }
+  std::vector<uint32_t> sessions;
+  sessions.swap(batch->second.sessions);
+  outgoingDiscoveryBatches_.erase(batch);
 
-  NDN_LOG_TRACE("received DISCOVERY for session " << sessionId );
+  NDN_LOG_TRACE("received DISCOVERY for " << sessions.size() << " sessions");
 
-  // check if the sequence number recieved as unknown session and triggered
-  // discovery is greater than the one received in the Discovery data
-  int updateSeq = content.Get(0).seqno().seq();
-  int savedSeq = (outgoingDiscoveryInterests_.find(content.Get(0).seqno().session()))->second;
+  bool isUpdated = false;
+  std::set<uint32_t> answered;
+  for (const SyncContentView::Entry& entry : content)
+  {
+    if (!entry.hasName())
+      continue;
+
+    // check if the sequence number recieved as unknown session and triggered
+    // discovery is greater than the one received in the Discovery data
+    int session = (int)entry.getSession();
+    int updateSeq = (int)entry.getSequence();
+    auto saved = outgoingDiscoveryInterests_.find(session);
+    if (saved != outgoingDiscoveryInterests_.end() && saved->second > updateSeq)
+      updateSeq = saved->second;
+    if (digestTree_->update(entry.getName(), session, updateSeq))
+      isUpdated = true;
+    answered.insert(session);
+  }
 
-  if(savedSeq > updateSeq)
-    isUpdated = digestTree_->update(content.Get(0).name(), content.Get(0).seqno().session(),savedSeq);
-  else
-    isUpdated = digestTree_->update(content.Get(0).name(), content.Get(0).seqno().session(),updateSeq);
+  // A responder stops adding entries when its Data is full, and older
+  // versions answer only the first session, so ask again for the rest as
+  // long as each Data answers some. Sessions nobody knows are dropped, and
+  // asked for again if they show up in another sync interest.
+  std::vector<uint32_t> unanswered;
+  for (uint32_t session : sessions)
+  {
+    if (answered.count(session) == 0 && !answered.empty())
+      unanswered.push_back(session);
+    else
+      outgoingDiscoveryInterests_.erase(session);
+    if (answered.count(session) != 0)
+      abandonedDiscoverySessions_.erase(session);
+  }
+  if (!unanswered.empty())
+    expressDiscoveryInterest(unanswered);
 
   return isUpdated;
 }
 
 // received intial sync data with "00"
 void
-ICTSync::Impl::initialOnData
-  (const google::protobuf::RepeatedPtrField<Sync::SyncState >& content)
+ICTSync::Impl::initialOnData(const SyncContentView& content)
 {
   NDN_LOG_DEBUG("initialOnData");
   update(content);
+  finishInitialization();
+}
 
+// Tell the application, and add this node to the state if it isn't there
+void
+ICTSync::Impl::finishInitialization()
+{
   try {
     onInitialized_();
 
@@ -867,14 +1670,12 @@ ICTSync::Impl::initialOnData
     // the user hasn't put himself in the digest tree.
     NDN_LOG_DEBUG("Add myself to digest");
     ++sequenceNo_;
-    Sync::SyncStateMsg tempContent;
-    Sync::SyncState* content2 = tempContent.add_ss();
-    content2->set_name(applicationDataPrefixUri_);
-    content2->set_type(Sync::SyncState_ActionType_UPDATE);
-    content2->mutable_seqno()->set_seq(sequenceNo_);
-    content2->mutable_seqno()->set_session(sessionNo_);
-
-    if (update(tempContent.ss()))
+    SyncContentEncoder encoder(CONTENT_FORMAT_TLV);
+    encoder.add(applicationDataPrefixUri_, SYNC_ACTION_UPDATE, sessionNo_, sequenceNo_);
+    SyncContentView content;
+    content.parse(encoder.encode());
+
+    if (update(content))
     {
       try {
         onInitialized_();
@@ -907,13 +1708,11 @@ ICTSync::Impl::initialTimeout(const Interest& interest)
     return;
   }
 
-  Sync::SyncStateMsg tempContent;
-  Sync::SyncState* content = tempContent.add_ss();
-  content->set_name(applicationDataPrefixUri_);
-  content->set_type(Sync::SyncState_ActionType_UPDATE);
-  content->mutable_seqno()->set_seq(sequenceNo_);
-  content->mutable_seqno()->set_session(sessionNo_);
-  update(tempContent.ss());
+  SyncContentEncoder encoder(CONTENT_FORMAT_TLV);
+  encoder.add(applicationDataPrefixUri_, SYNC_ACTION_UPDATE, sessionNo_, sequenceNo_);
+  SyncContentView content;
+  content.parse(encoder.encode());
+  update(content);
 
   try {
     onInitialized_();
@@ -923,8 +1722,7 @@ ICTSync::Impl::initialTimeout(const Interest& interest)
     NDN_LOG_ERROR("ICTSync::Impl::initialTimeout: Error in onInitialized.");
   }
 
-  Name name(applicationBroadcastPrefix_);
-  name.append(digestTree_->getVectorRoot());
+  Name name = makeSyncInterestName();
 
   //sendSyncInterest(syncLifetime_);
   sendSyncInterest(name, syncLifetime_);
@@ -963,26 +1761,28 @@ ICTSync::Impl::broadcastSyncData()
     NDN_LOG_DEBUG("Checking pending Interest: " << pendingInterests[i]->getInterest().getName() );
 
     // get diff
-    string pendingDigest = pendingInterests[i]->getInterest().getName().get
-      (applicationBroadcastPrefix_.size()).toUri();//EscapedString();
-
-    pendingDigest = unescape(pendingDigest);
-
-    // Get index list of set-difference
-    std::vector<uint8_t> indexList;
-    std::vector<std::tuple<uint32_t, uint32_t>> RemoteUpdates;
-    std::vector<std::tuple<uint32_t, uint32_t>> unknownSessions;
-    bool pushDataName;
-    if(digestTree_->getDiff(pendingDigest, indexList,RemoteUpdates,unknownSessions,pushDataName) == -1)
+    const Name& pendingName = pendingInterests[i]->getInterest().getName();
+
+    // Get index list of set-difference. Pending interests with the same
+    // state share one cached diff.
+    name::Component pendingState;
+    if (!getStateComponent(pendingInterests[i]->getInterest(), pendingState))
+      continue;
+    std::shared_ptr<const DiffResult> diff = getDiff(pendingState, pendingInterests[i].get());
+    const std::vector<uint32_t>& indexList = diff->positiveLocalIndexes;
+    if(indexList.empty())
     {
       NDN_LOG_DEBUG("No diff. quit");
     }
     else
     {
       NDN_LOG_DEBUG("set-diff size is  " << indexList.size()
-                 << " for pending digest " << pendingDigest);
-      if(!sendSyncData(pendingDigest, indexList, face_, pushDataName))//pendingInterests[i]->getFace(),pushDataName))
-        NDN_LOG_ERROR("Failed to send Sync Data for pending: " << pendingDigest);
+                 << " for pending interest " << pendingName);
+      if(!sendSyncData(pendingName, indexList, face_, diff->pushLocalSessions))//pendingInterests[i]->getFace(),pushDataName))
+        NDN_LOG_ERROR("Failed to send Sync Data for pending: " << pendingName);
+      else
+        // the one Data also answers the interests aggregated into this one
+        statistics_.suppressedSyncData += pendingInterests[i]->getDuplicateCount();
 
     }
   }
@@ -990,22 +1790,18 @@ ICTSync::Impl::broadcastSyncData()
 
 void ICTSync::Impl::sendSyncInterest(time::milliseconds syncLifetime)
 {
-  Name name(applicationBroadcastPrefix_);
-  std::string sdigest = digestTree_->getVectorRoot();
-  name.append(sdigest);
+  Name name = makeSyncInterestName();
   if (syncUpdateInterval_.count() > 0)
     {
       std::chrono::milliseconds nowms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
       if (nowms >= nextInterestTs_)
 	{
-	  lastSentDigest_ = sdigest;
 	  sendSyncInterest(name, syncLifetime);
 	  //nextInterestTs_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()) + syncUpdateInterval_;
 	}
     }
   else
     {
-      lastSentDigest_ = sdigest;
       sendSyncInterest(name, syncLifetime);
     }
 }
@@ -1015,10 +1811,20 @@ void ICTSync::Impl::sendSyncInterest(Name& interestName,
 {
   Interest interest(interestName);
   interest.setInterestLifetime(syncLifetime);
+  const name::Component& nameState = interestName.get(applicationBroadcastPrefix_.size());
+  if (nameState.type() == ICTVectorState::STATE_DIGEST_COMPONENT_TYPE)
+    // the name only has the digest, so send the state as the parameters
+    interest.setApplicationParameters(makeStateComponent());
   std::string iname = interestName.toUri();
+
+  // remember the state we advertised so checkForUpdate can compare in O(1)
+  lastSentFingerprint_ = digestTree_->getFingerprint();
+  lastSentRootSize_ = digestTree_->getVectorRoot().size();
   
   //if (lastInterestId_)
     lastInterestId_.cancel();
+  syncInterestEvent_.cancel();
+  isSyncInterestScheduled_ = false;
   
   //PendingInterestHandle newInterestID
   lastInterestId_  = face_.expressInterest(interest,
@@ -1028,7 +1834,7 @@ void ICTSync::Impl::sendSyncInterest(Name& interestName,
   if (syncUpdateInterval_.count() > 0)
     {
       nextInterestTs_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()) + syncUpdateInterval_;
-      scheduler_->schedule(time::milliseconds(syncUpdateInterval_.count()), bind(&ICTSync::Impl::checkForUpdate, this));
+      scheduleCheckForUpdate();
     }
   
   //lastInterestId_ = newInterestID;
@@ -1037,18 +1843,106 @@ void ICTSync::Impl::sendSyncInterest(Name& interestName,
   
 }
 
+void
+ICTSync::Impl::scheduleSyncInterest()
+{
+  if (suppressionMaxDelay_.count() <= 0)
+  {
+    sendSyncInterest(syncLifetime_);
+    return;
+  }
+  if (isSyncInterestScheduled_)
+    return;
+
+  time::milliseconds delay(random::generateWord32() % (suppressionMaxDelay_.count() + 1));
+  syncInterestEvent_ = scheduler_->schedule
+    (delay, bind(&ICTSync::Impl::sendScheduledSyncInterest, shared_from_this()));
+  isSyncInterestScheduled_ = true;
+  NDN_LOG_TRACE("Sync interest scheduled in " << delay.count() << " ms");
+}
+
+void
+ICTSync::Impl::sendScheduledSyncInterest()
+{
+  isSyncInterestScheduled_ = false;
+  if (!enabled_)
+    return;
+
+  if (isCoveredByOverheardState())
+  {
+    // Another member's interest covers our state and will bring the same
+    // updates. Check again within a sync lifetime, in case it is not renewed.
+    ++statistics_.suppressedSyncInterests;
+    time::milliseconds delay(syncLifetime_.count() / 2 +
+                             random::generateWord32() % (syncLifetime_.count() / 2 + 1));
+    syncInterestEvent_ = scheduler_->schedule
+      (delay, bind(&ICTSync::Impl::sendScheduledSyncInterest, shared_from_this()));
+    isSyncInterestScheduled_ = true;
+    NDN_LOG_DEBUG("Sync interest suppressed, checking again in " << delay.count() << " ms");
+    return;
+  }
+  sendSyncInterest(syncLifetime_);
+}
+
+void
+ICTSync::Impl::overhearCoveringState()
+{
+  overheardVersion_ = digestTree_->getVersion();
+  overheardTime_ = time::steady_clock::now();
+}
+
+bool
+ICTSync::Impl::isCoveredByOverheardState() const
+{
+  return overheardVersion_ == digestTree_->getVersion() &&
+         time::steady_clock::now() - overheardTime_ < syncLifetime_;
+}
+
 void ICTSync::Impl::checkForUpdate()
 {
-  if (digestTree_->getVectorRoot() != lastSentDigest_)
+  if (digestTree_->getFingerprint() != lastSentFingerprint_ ||
+      digestTree_->getVectorRoot().size() != lastSentRootSize_)
     {
-      sendSyncInterest(syncLifetime_);
-      NDN_LOG_DEBUG("checkForUpdate: state changed calling sendSyncInterest");
+      // With suppression, the change waits for its random delay like any
+      // other, and is not sent while an overheard interest covers it.
+      if (suppressionMaxDelay_.count() > 0 &&
+          (isSyncInterestScheduled_ || isCoveredByOverheardState()))
+        NDN_LOG_TRACE("checkForUpdate: state changed, sync interest scheduled or covered");
+      else
+        {
+          NDN_LOG_DEBUG("checkForUpdate: state changed calling scheduleSyncInterest");
+          scheduleSyncInterest();
+        }
     }
   else
     {
       NDN_LOG_DEBUG("checkForUpdate: no state change");
     }
-  scheduler_->schedule(time::milliseconds(syncUpdateInterval_.count()), bind(&ICTSync::Impl::checkForUpdate, this));
+  scheduleCheckForUpdate();
+}
+
+void
+ICTSync::Impl::scheduleCheckForUpdate()
+{
+  if (!manager_)
+  {
+    scheduler_->schedule(time::milliseconds(syncUpdateInterval_.count()), bind(&ICTSync::Impl::checkForUpdate, this));
+    return;
+  }
+
+  // With no interval, an own scheduler checks continuously and the
+  // manager's timers check at every tick. The manager's timers cannot be
+  // cancelled, so an earlier timer which fires before checkForUpdateDue_ is
+  // ignored.
+  checkForUpdateDue_ = TimerWheel::Clock::now() + syncUpdateInterval_;
+  manager_->scheduleCheckForUpdate(groupId_, checkForUpdateDue_);
+}
+
+void
+ICTSync::Impl::onCheckForUpdateTimer(TimerWheel::Clock::time_point now)
+{
+  if (enabled_ && now >= checkForUpdateDue_)
+    checkForUpdate();
 }
 
 }
@@ -29,7 +29,13 @@
 #include <vector>
 #include <ndn-cxx/face.hpp>
 #include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
 #include "pending-interests.hpp"
+#include "ict-vector-state.hpp"
+#include "lru-cache.hpp"
+#include "signing-strategy.hpp"
+#include "signing-pool.hpp"
+#include "sync-content.hpp"
 #include <chrono>
 
 namespace google { namespace protobuf { template <typename Element> class RepeatedPtrField; } }
@@ -40,6 +46,7 @@ using namespace ndn;
 namespace ict {
 
 class ICTVectorState;
+class ICTSyncManager;
 
 /**
  * ICTSync implements
@@ -162,6 +169,53 @@ public:
     int sessionNo_;
   };
 
+  /**
+   * Statistics holds counters of the work done by an ICTSync, for monitoring
+   * and tuning. The counters only increase.
+   */
+  struct Statistics {
+    // sync interest diffs found in the diff cache
+    uint64_t diffCacheHits = 0;
+    // sync interest diffs which had to be computed
+    uint64_t diffCacheMisses = 0;
+    // sync, newcomer and discovery Data answered from the signed Data cache
+    // instead of being built and signed again
+    uint64_t signedDataCacheHits = 0;
+    uint64_t signedDataCacheMisses = 0;
+    // times the full state sent to newcomers was serialized, once per state
+    // at most while it stays in the snapshot cache
+    uint64_t newcomerSnapshotBuilds = 0;
+    // sync interests aggregated into a pending interest with the same name
+    uint64_t aggregatedInterests = 0;
+    // sync Data not sent because the pending interest they would answer was
+    // aggregated into one already answered
+    uint64_t suppressedSyncData = 0;
+    // pending interests evicted to keep the table within its limits
+    uint64_t evictedInterests = 0;
+    // sequence numbers published, and the number of state updates which
+    // published them. publishedSequenceNumbers / publishBatches is the
+    // batching factor achieved by publish coalescing and batched publishes.
+    uint64_t publishedSequenceNumbers = 0;
+    uint64_t publishBatches = 0;
+    // current number and approximate bytes of pending interests
+    size_t pendingInterests = 0;
+    size_t pendingInterestBytes = 0;
+    // current number of Data waiting for a signing thread
+    size_t signingQueueDepth = 0;
+    // discovery interests expressed, each for a batch of unknown sessions,
+    // and the sessions they asked for
+    uint64_t discoveryInterests = 0;
+    uint64_t discoveryRequestedSessions = 0;
+    // discovery interests expressed again after a timeout or Nack
+    uint64_t discoveryRetries = 0;
+    // unknown sessions given up on after DISCOVERY_RETRIES retries, which
+    // are then held off before being asked for again
+    uint64_t abandonedDiscoverySessions = 0;
+    // sync interests not expressed because another member's covered the
+    // local state, see setSyncInterestSuppression
+    uint64_t suppressedSyncInterests = 0;
+  };
+
   /**
    * Get a copy of the current list of producer data prefixes, and the
    * associated session number. You can use these in getProducerSequenceNo().
@@ -213,6 +267,77 @@ public:
     return impl_->publishNextSequenceNo(applicationInfo);
   }
 
+  /**
+   * Increment the sequence number by count and publish the result like
+   * publishNextSequenceNo, but with a single state update, a single
+   * broadcast to the pending interests and a single sync interest for the
+   * whole batch. Use this when the application produces a burst of items.
+   * Does nothing if count is not positive, or if the sequence number would
+   * exceed INT_MAX.
+   * @param count The number of new sequence numbers.
+   * @param applicationInfo (optional) See publishNextSequenceNo.
+   */
+  void
+  publishSequenceNumbers(int count, const Block& applicationInfo = Block())
+  {
+    impl_->publishSequenceNumbers(count, applicationInfo);
+  }
+
+  /**
+   * Set the sequence number to sequenceNo and publish it as a single batch,
+   * like publishSequenceNumbers. Does nothing if sequenceNo is not greater
+   * than getSequenceNo().
+   * @param sequenceNo The new sequence number.
+   * @param applicationInfo (optional) See publishNextSequenceNo.
+   */
+  void
+  publishUpTo(int sequenceNo, const Block& applicationInfo = Block())
+  {
+    impl_->publishUpTo(sequenceNo, applicationInfo);
+  }
+
+  /**
+   * Set how this node writes its state vector in the sync interests it
+   * expresses. All nodes accept both encodings, so every member of the sync
+   * group should be configured the same way. The default is
+   * STATE_ENCODING_TEXT. With STATE_ENCODING_COMPRESSED, the content of the
+   * sync and newcomer Data is also gzipped when that makes it smaller, which
+   * only nodes with this version can read.
+   * @param encoding The state encoding for outgoing sync interests.
+   */
+  void
+  setStateEncoding(StateEncoding encoding)
+  {
+    impl_->setStateEncoding(encoding);
+  }
+
+  /**
+   * Set the format of the content of the sync, newcomer and discovery Data
+   * this node sends. All nodes of this version read both formats, so switch
+   * to CONTENT_FORMAT_TLV once every member of the sync group is upgraded.
+   * The default is CONTENT_FORMAT_PROTOBUF.
+   */
+  void
+  setContentFormat(ContentFormat format)
+  {
+    impl_->setContentFormat(format);
+  }
+
+  /**
+   * Carry the state in the ApplicationParameters of the sync interests this
+   * node expresses when its name component would be larger than threshold
+   * bytes. The name then holds a short digest of the state, so forwarders
+   * can still aggregate the interests of members with the same state. All
+   * nodes accept both forms.
+   * @param threshold The largest state kept in the name, or 0 (the default)
+   * to always keep it in the name.
+   */
+  void
+  setStateInParameters(size_t threshold)
+  {
+    impl_->setStateInParameters(threshold);
+  }
+
   /**
    * Get the sequence number of the latest data published by this application
    * instance.
@@ -224,6 +349,102 @@ public:
     return impl_->getSequenceNo();
   }
 
+  /**
+   * Get the counters of the work done so far.
+   */
+  Statistics
+  getStatistics() const
+  {
+    return impl_->getStatistics();
+  }
+
+  /**
+   * Coalesce calls to publishNextSequenceNo for high-rate producers. The first
+   * call after a published state starts a window. During the window the calls
+   * only increment the sequence number, and the state update, broadcast and
+   * sync interest are done once when the window closes, or as soon as
+   * maxBatch sequence numbers are waiting. publishSequenceNumbers and
+   * publishUpTo always publish at once, including any waiting sequence
+   * numbers.
+   * @param window The coalescing window, or 0 (the default) to publish each
+   * call at once.
+   * @param maxBatch The maximum number of sequence numbers to hold back, or 0
+   * for no limit.
+   */
+  void
+  setPublishCoalescing(std::chrono::milliseconds window, int maxBatch = 0)
+  {
+    impl_->setPublishCoalescing(window, maxBatch);
+  }
+
+  /**
+   * Suppress redundant sync interests in large groups. After receiving sync
+   * Data or updates carried by a sync interest, a node waits a random delay
+   * up to maxDelay before expressing its new sync interest, and does not
+   * express it if meanwhile it hears a sync interest from another member
+   * whose state covers its own: the same state, or one in which the node
+   * has nothing newer and knows every session. It then checks again about
+   * one sync lifetime later, so some member keeps a sync interest out.
+   * State changes found by the periodic check for updates are held back the
+   * same way. Publishing and the refresh after a sync interest times out are never
+   * delayed.
+   * @param maxDelay The maximum delay, or 0 (the default) to express the sync
+   * interest at once. Larger groups need a larger delay to spread the
+   * interests out. Every member of the sync group should use the same value.
+   */
+  void
+  setSyncInterestSuppression(std::chrono::milliseconds maxDelay)
+  {
+    impl_->setSyncInterestSuppression(maxDelay);
+  }
+
+  /**
+   * Set how each kind of sync Data is signed. By default all are signed with
+   * the certificateName given to the constructor. Cheaper modes trade
+   * authenticity for CPU, see SigningMode.
+   */
+  void
+  setSigningStrategy(const SigningStrategy& signingStrategy)
+  {
+    impl_->setSigningStrategy(signingStrategy);
+  }
+
+  /**
+   * Sign sync Data on worker threads instead of the Face's io thread, so that
+   * slow signatures do not hold up the processing of interests. The signed
+   * Data is put from the io thread, in order for each name. Each thread uses
+   * its own KeyChain, by default opened with the PIB and TPM of the KeyChain
+   * given to the constructor, so the certificate of the SigningStrategy must
+   * be found there. Data which fails to sign is dropped, with an error
+   * logged, and so is not answered.
+   * @param threadCount The number of signing threads, or 0 (the default) to
+   * sign on the io thread.
+   * @param makeKeyChain Makes the KeyChain of each thread instead, for
+   * example to import keys into an in-memory PIB and TPM, which cannot be
+   * opened again by locator. See SigningPool::getKeyChainFactory.
+   */
+  void
+  setSigningThreads(size_t threadCount,
+                    const SigningPool::KeyChainFactory& makeKeyChain = nullptr)
+  {
+    impl_->setSigningThreads(threadCount, makeKeyChain);
+  }
+
+  /**
+   * Limit the table of sync interests which could not be answered yet, so
+   * that its memory stays bounded under a burst of interests. See
+   * InterestList::setLimits.
+   * @param capacity The maximum number of interests, or 0 for no limit.
+   * @param byteBudget The maximum number of bytes, or 0 for no limit.
+   * @param policy Which interest to evict when over a limit.
+   */
+  void
+  setPendingInterestLimits(size_t capacity, size_t byteBudget,
+                           InterestList::EvictionPolicy policy = InterestList::EVICT_OLDEST)
+  {
+    impl_->setPendingInterestLimits(capacity, byteBudget, policy);
+  }
+
   /**
    * Unregister callbacks so that this does not respond to interests anymore.
    * If you will delete this ICTSync object while your application is
@@ -241,6 +462,7 @@ public:
   }
 
 private:
+  friend class ICTSyncManager;
 
   /**
    * ICTSync::Impl does the work of ICTSync. It is a separate
@@ -275,6 +497,32 @@ private:
     void
     reRegister(const  RegisterPrefixFailureCallback& onRegisterFailed);
 
+    /**
+     * Let manager receive the interests for applicationBroadcastPrefix and
+     * run the checkForUpdate timer, and use its scheduler, instead of
+     * registering the prefix and creating a scheduler in initialize(). You
+     * must call this before initialize().
+     * @param groupId The id of this group in the timers of manager.
+     */
+    void
+    setManager(ICTSyncManager* manager, uint64_t groupId,
+               const std::shared_ptr<ndn::Scheduler>& scheduler)
+    {
+      manager_ = manager;
+      groupId_ = groupId;
+      scheduler_ = scheduler;
+    }
+
+    /**
+     * Sign with the given pool, which may be shared with other groups, or
+     * on the io thread if it is null.
+     */
+    void
+    setSigningPool(const std::shared_ptr<SigningPool>& signingPool)
+    {
+      signingPool_ = signingPool;
+    }
+
     /**
      * See ICTSync::getProducerPrefixes.
      */
@@ -293,12 +541,101 @@ private:
     void
     publishNextSequenceNo(const Block& applicationInfo);
 
+    /**
+     * See ICTSync::publishSequenceNumbers.
+     */
+    void
+    publishSequenceNumbers(int count, const Block& applicationInfo);
+
+    /**
+     * See ICTSync::publishUpTo.
+     */
+    void
+    publishUpTo(int sequenceNo, const Block& applicationInfo);
+
+    /**
+     * See ICTSync::setPublishCoalescing.
+     */
+    void
+    setPublishCoalescing(std::chrono::milliseconds window, int maxBatch);
+
+    /**
+     * See ICTSync::setSyncInterestSuppression.
+     */
+    void
+    setSyncInterestSuppression(std::chrono::milliseconds maxDelay)
+    {
+      suppressionMaxDelay_ = maxDelay;
+    }
+
     /**
      * See ICTSync::getSequenceNo.
      */
     int
     getSequenceNo() const { return sequenceNo_; }
 
+    /**
+     * See ICTSync::setStateEncoding.
+     */
+    void
+    setStateEncoding(StateEncoding encoding)
+    {
+      stateEncoding_ = encoding;
+      // the cached Data and snapshots may be encoded the old way
+      invalidateSignedData();
+      invalidateNewcomerSnapshots();
+    }
+
+    /**
+     * See ICTSync::setContentFormat.
+     */
+    void
+    setContentFormat(ContentFormat format)
+    {
+      contentFormat_ = format;
+      invalidateSignedData();
+      invalidateNewcomerSnapshots();
+    }
+
+    /**
+     * See ICTSync::setStateInParameters.
+     */
+    void
+    setStateInParameters(size_t threshold) { parametersThreshold_ = threshold; }
+
+    /**
+     * See ICTSync::getStatistics.
+     */
+    Statistics
+    getStatistics() const;
+
+    /**
+     * See ICTSync::setSigningStrategy.
+     */
+    void
+    setSigningStrategy(const SigningStrategy& signingStrategy)
+    {
+      signingStrategy_ = signingStrategy;
+      // the cached Data may be signed the old way
+      invalidateSignedData();
+    }
+
+    /**
+     * See ICTSync::setSigningThreads.
+     */
+    void
+    setSigningThreads(size_t threadCount, const SigningPool::KeyChainFactory& makeKeyChain);
+
+    /**
+     * See ICTSync::setPendingInterestLimits.
+     */
+    void
+    setPendingInterestLimits(size_t capacity, size_t byteBudget,
+                             InterestList::EvictionPolicy policy)
+    {
+      pendingInterests_.setLimits(capacity, byteBudget, policy);
+    }
+
     /**
      * See ICTSync::shutdown.
      */
@@ -306,6 +643,187 @@ private:
     shutdown();
 
   private:
+    friend class ICTSyncManager;
+
+    /**
+     * A DiffResult is the set-difference between the local state at some
+     * version and the state name component of a sync interest.
+     */
+    struct DiffResult {
+      // the component, to rule out fingerprint collisions
+      name::Component stateComponent;
+      std::shared_ptr<const ICTVectorState::RemoteState> remoteState;
+      std::vector<uint32_t> positiveLocalIndexes;
+      std::vector<std::tuple<uint32_t, uint32_t>> negativeInLocal;
+      std::vector<std::tuple<uint32_t, uint32_t>> unknownSessions;
+      bool pushLocalSessions = false;
+      // false if only positiveLocalIndexes and pushLocalSessions were
+      // computed, for a pending interest
+      bool hasRemoteUpdates = false;
+    };
+
+    /**
+     * The diff cache is keyed by a fingerprint of the state component and
+     * the local state version.
+     */
+    struct DiffCacheKey {
+      uint64_t stateFingerprint;
+      uint64_t stateVersion;
+
+      bool
+      operator==(const DiffCacheKey& other) const
+      {
+        return stateFingerprint == other.stateFingerprint &&
+          stateVersion == other.stateVersion;
+      }
+    };
+
+    struct DiffCacheKeyHash {
+      size_t
+      operator()(const DiffCacheKey& key) const
+      {
+        return key.stateFingerprint ^ (key.stateVersion * 0x9E3779B97F4A7C15ULL);
+      }
+    };
+
+    // Peers in a converged group send the same state, so only a few recent
+    // states need to be kept.
+    static const size_t DIFF_CACHE_CAPACITY = 32;
+
+    // Responses only repeat while the local state is the same, so this only
+    // needs to hold the Data for the distinct names peers ask for meanwhile.
+    static const size_t SIGNED_DATA_CACHE_CAPACITY = 128;
+
+    /**
+     * Find the signed Data named name made from the current local state.
+     * @return The Data, or null if it is not cached.
+     */
+    std::shared_ptr<const Data>
+    findSignedData(const Name& name);
+
+    /**
+     * A newcomer snapshot split into segments which fit in a packet. Each
+     * segment is a SyncStateMsg with some of the entries, so a newcomer can
+     * apply it on its own.
+     */
+    struct SegmentedSnapshot {
+      std::vector<ndn::ConstBufferPtr> segments;
+    };
+
+    // content bytes per segment, well below the NDN packet size limit
+    static const size_t SNAPSHOT_SEGMENT_SIZE = 4096;
+    // snapshots of recent states kept to answer segment interests
+    static const size_t SNAPSHOT_CACHE_CAPACITY = 4;
+    // segment interests a newcomer keeps in flight
+    static const size_t SNAPSHOT_FETCH_WINDOW = 8;
+    static const int SNAPSHOT_SEGMENT_RETRIES = 3;
+
+    /**
+     * Get the segmented snapshot of the local state, built once per state.
+     * Segments are named
+     * /<broadcast prefix>/00/<encoding>/<version>/<segment> where the
+     * encoding is getSnapshotEncoding() and the version is the state
+     * fingerprint, so any member with the same state and settings makes the
+     * same segments and can answer for them. Snapshots are kept by
+     * fingerprint in segmentedSnapshots_.
+     */
+    std::shared_ptr<const SegmentedSnapshot>
+    getSegmentedSnapshot();
+
+    /**
+     * Get the number which identifies how the segments are made: the content
+     * format, which sets where segments split, times 2, plus 1 if they are
+     * compressed.
+     */
+    uint64_t
+    getSnapshotEncoding() const
+    {
+      return (uint64_t)contentFormat_ * 2 +
+        (stateEncoding_ == STATE_ENCODING_COMPRESSED ? 1 : 0);
+    }
+
+    void
+    sendSnapshotSegment
+      (const Name& versionedName, const SegmentedSnapshot& snapshot, uint64_t segment,
+       Face& face);
+
+    /**
+     * The fetch of a segmented snapshot by a newcomer. The first segment
+     * answers the "00" interest, then the others are fetched with up to
+     * SNAPSHOT_FETCH_WINDOW interests in flight.
+     */
+    struct SnapshotFetch {
+      // /<broadcast prefix>/00/<encoding>/<version>
+      Name versionedName;
+      std::vector<bool> received;
+      size_t receivedCount = 0;
+      // the next segment to request. The first one is not requested.
+      uint64_t nextSegment = 1;
+      size_t inFlight = 0;
+      std::map<uint64_t, int> retries;
+    };
+
+    bool
+    isSnapshotSegment(const Name& name) const;
+
+    // Apply a snapshot segment and request more.
+    void
+    onSnapshotSegment(const Data& data);
+
+    void
+    requestSnapshotSegments();
+
+    void
+    expressSnapshotInterest(uint64_t segment);
+
+    void
+    snapshotSegmentTimeout(const Interest& interest);
+
+    void
+    snapshotSegmentNack(const Interest& interest, const lp::Nack& nack) { snapshotSegmentTimeout(interest); }
+
+    // Initialize with the segments received.
+    void
+    finishSnapshotFetch();
+
+    /**
+     * Sign data as the given kind, on the signing pool if there is one, and
+     * put it with putSignedData.
+     * @return False if the Data was signed here and could not be put.
+     */
+    bool
+    signAndPut(const std::shared_ptr<Data>& data, SyncDataKind kind, Face& face);
+
+    /**
+     * Put data, and keep it in the signed Data cache if the local state is
+     * still at version, the version it was made from, and the cache was not
+     * invalidated since generation.
+     */
+    bool
+    putSignedData(const std::shared_ptr<const Data>& data, uint64_t version,
+                  uint64_t generation, Face& face);
+
+    /**
+     * Clear the signed Data cache after a change of the signing or encoding
+     * settings, and keep Data still being signed from entering it.
+     */
+    void
+    invalidateSignedData()
+    {
+      signedDataCache_.clear();
+      ++signedDataGeneration_;
+    }
+
+    /**
+     * Make the newcomer snapshots be built again, after a change of the
+     * encoding settings.
+     */
+    void
+    invalidateNewcomerSnapshots()
+    {
+      segmentedSnapshots_.clear();
+    }
+
     /**
     * Express an interest.
     @param interest name.
@@ -319,10 +837,54 @@ private:
     */
     void sendSyncInterest(time::milliseconds syncLifetime);
 
+    /**
+     * Make the sync interest name applicationBroadcastPrefix_ + local state,
+     * with the state written in stateEncoding_, or + the state digest if the
+     * state goes in the ApplicationParameters.
+     */
+    Name
+    makeSyncInterestName() const;
+
+    /**
+     * Make the name component of the local state, written in stateEncoding_.
+     */
+    name::Component
+    makeStateComponent() const;
+
+    /**
+     * Encode the entries as the content of a sync or newcomer Data. With
+     * STATE_ENCODING_COMPRESSED the content is gzipped if that is smaller.
+     */
+    Block
+    makeSyncContent(const SyncContentEncoder& encoder) const;
+
+    /**
+     * Make the STATE_DIGEST_COMPONENT_TYPE name component of the local state.
+     */
+    name::Component
+    makeStateDigestComponent() const;
+
+    /**
+     * Get the state of a sync interest, from its name or, if the name has a
+     * state digest, from its ApplicationParameters.
+     * @return False if the ApplicationParameters are missing or malformed.
+     */
+    bool
+    getStateComponent(const Interest& interest, name::Component& stateComponent) const;
+
+    /**
+     * Check if the state name component of a sync interest (in either
+     * encoding, or a state digest) is the same as the local state.
+     */
+    bool
+    isLocalState(const name::Component& stateComponent) const;
+
    /**
     * Go over the list of pending interests, and calculate the set-difference
-    * between local state and pending interest state. create a data packet for
-    * each set-diff, sign and send. The name of all data packets
+    * between local state and pending interest state. Only the entries changed
+    * since the pending interest was stored are compared. Interests with the
+    * same name are aggregated when stored, so there is one diff per distinct
+    * state. create a data packet for each set-diff, sign and send. The name of all data packets
     * is applicationBroadcastPrefix_ + pedning vector state
     */
     void
@@ -337,7 +899,7 @@ private:
      * only with new updates)
      */
     bool
-    update(const google::protobuf::RepeatedPtrField<Sync::SyncState >& content);
+    update(const SyncContentView& content);
 
     /**
      * Process the sync interest from the applicationBroadcastPrefix. If we can't
@@ -376,6 +938,71 @@ private:
     processDiscoveryInterest
       (const Interest& interest, Face& face);
 
+    // unknown sessions asked for in one discovery interest
+    static const size_t DISCOVERY_BATCH_SIZE = 64;
+    // a discovery Data stops taking entries past this content size
+    static const size_t DISCOVERY_CONTENT_SIZE = 4096;
+    // A timed out discovery interest is expressed again after a random
+    // delay up to a backoff which starts at DISCOVERY_BACKOFF_INITIAL_MS and
+    // doubles with each retry, up to DISCOVERY_BACKOFF_MAX_MS. After
+    // DISCOVERY_RETRIES retries its sessions are abandoned.
+    static const int DISCOVERY_RETRIES = 4;
+    static const int DISCOVERY_BACKOFF_INITIAL_MS = 250;
+    static const int DISCOVERY_BACKOFF_MAX_MS = 8000;
+    // An abandoned session is not asked for again for a hold-off which
+    // starts at DISCOVERY_HOLDOFF_INITIAL_MS and doubles each time it is
+    // abandoned, up to DISCOVERY_HOLDOFF_MAX_MS. It is forgotten after a
+    // further DISCOVERY_HOLDOFF_MAX_MS without being abandoned again.
+    static const int DISCOVERY_HOLDOFF_INITIAL_MS = 10000;
+    static const int DISCOVERY_HOLDOFF_MAX_MS = 600000;
+
+    struct DiscoveryBatch {
+      std::vector<uint32_t> sessions;
+      // times the interest was expressed again
+      int retries = 0;
+      ndn::scheduler::ScopedEventId retryEvent;
+    };
+
+    struct AbandonedSession {
+      int abandonments = 0;
+      time::steady_clock::time_point holdOffUntil;
+    };
+
+    /**
+     * Express a discovery interest /<prefix>/DISCOVERY/<s1.s2...> for the
+     * given sessions, at most DISCOVERY_BATCH_SIZE, and track it in
+     * outgoingDiscoveryBatches_. A single session gives the name used by
+     * older versions.
+     */
+    void
+    expressDiscoveryInterest(const std::vector<uint32_t>& sessions);
+
+    void
+    sendDiscoveryInterest(const Name& name);
+
+    /**
+     * Give up on the sessions of the discovery batch with the given
+     * interest name and start their hold-off.
+     */
+    void
+    abandonDiscoveryBatch(const Name& name);
+
+    /**
+     * Forget the abandoned sessions which are now known or whose hold-off
+     * ended more than DISCOVERY_HOLDOFF_MAX_MS ago.
+     */
+    void
+    expireAbandonedDiscoveries(time::steady_clock::time_point now);
+
+    /**
+     * Parse the sessions of a discovery interest name component.
+     * @return false if it is not a list of at most DISCOVERY_BATCH_SIZE
+     * sessions.
+     */
+    static bool
+    parseDiscoverySessions(const name::Component& component,
+                           std::vector<uint32_t>& sessions);
+
     void
     discoveryTimeout(const Interest& interest);
 
@@ -390,17 +1017,41 @@ private:
      */
     void
     processSyncInterest(const Interest& interest,
-                        const std::string& syncDigest,
+                        const name::Component& stateComponent,
                         Face& face);
 
+    /**
+     * Parse the state name component of a sync interest, in the encoding
+     * given by its type. See ICTVectorState::parseState.
+     */
+    static void
+    parseState(const name::Component& stateComponent,
+               ICTVectorState::RemoteState& remote);
+
+    /**
+     * Get the set-difference between the local state and the state name
+     * component of a sync interest from the diff cache, or compute and cache
+     * it.
+     * @param pending If not null, the pending interest with this state. Then
+     * only the positive indexes are needed and they are found with
+     * ICTVectorState::getDiffSince.
+     */
+    std::shared_ptr<const DiffResult>
+    getDiff(const name::Component& stateComponent,
+            const InterestList::PendingInterest* pending);
+
+    /**
+     * Send the sync Data named dataName (the name of the sync interest it
+     * answers) with the local entries in indexListToSend.
+     */
     bool
-    sendSyncData (const std::string& syncDigest, std::vector<uint8_t>& indexListToSend, Face& face, bool sendName);
+    sendSyncData (const Name& dataName, const std::vector<uint32_t>& indexListToSend, Face& face, bool sendName);
 
     void
-    processInterestUpdates(std::vector<std::tuple<uint32_t, uint32_t>>& RemoteUpdates);
+    processInterestUpdates(const std::vector<std::tuple<uint32_t, uint32_t>>& RemoteUpdates);
 
     void
-    processUnknownSessionIds(std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessionIds);
+    processUnknownSessionIds(const std::vector<std::tuple<uint32_t, uint32_t>>& unknownSessionIds);
     // Sync interest time out, if the interest is the static one send again.
     void
     syncTimeout(const Interest& interest);
@@ -411,25 +1062,105 @@ private:
 
     // Process initial data which usually includes all other publisher's info, and send back the new comer's own info.
     void
-    initialOnData(const google::protobuf::RepeatedPtrField<Sync::SyncState >& content);
+    initialOnData(const SyncContentView& content);
+
+    void
+    finishInitialization();
+
+    void
+    notifyApplication(const SyncContentView& content);
 
     bool
     onDiscoveryData
         (const Interest& interest,
-         const google::protobuf::RepeatedPtrField<Sync::SyncState >& content);
+         const SyncContentView& content);
 
     void
     initialOndataOLD(const google::protobuf::RepeatedPtrField<Sync::SyncState >& content);
 
+    /**
+     * Raise sequenceNo_ and publishedSequenceNo_ to a sequence number of
+     * the local session learned from a peer, for example after a restart.
+     */
+    void
+    raiseSequenceNo(int sequenceNo);
+
     void //checks for state change at interval of syncInterval
     checkForUpdate();
 
+    /**
+     * Call checkForUpdate after syncUpdateInterval_, from the timers of
+     * manager_ if there is one.
+     */
+    void
+    scheduleCheckForUpdate();
+
+    /**
+     * Called by manager_ when a checkForUpdate timer of this group fires at
+     * now. Only the latest timer scheduled is acted on.
+     */
+    void
+    onCheckForUpdateTimer(TimerWheel::Clock::time_point now);
+
+    /**
+     * Put sequenceNo_ in the local state, answer the pending interests and
+     * send a new sync interest.
+     */
+    void
+    commitSequenceNo();
+
+    // called when the publish coalescing window closes
+    void
+    flushCoalescedPublishes();
+
+    /**
+     * Express a sync interest for the local state, after a random delay if
+     * suppression is on. A sync interest which is already scheduled is not
+     * moved.
+     */
+    void
+    scheduleSyncInterest();
+
+    /**
+     * Express the scheduled sync interest, unless an interest from another
+     * member covering the local state was heard recently, in which case
+     * check again later.
+     */
+    void
+    sendScheduledSyncInterest();
+
+    /**
+     * Record that a sync interest whose state covers the local state was
+     * heard.
+     */
+    void
+    overhearCoveringState();
+
+    /**
+     * Check if a sync interest covering the current local state was heard
+     * within the last sync lifetime.
+     */
+    bool
+    isCoveredByOverheardState() const;
+
 
     Face& face_;
     KeyChain& keyChain_;
     Name certificateName_;
+    SigningStrategy signingStrategy_;
     time::milliseconds syncLifetime_;
     std::chrono::milliseconds syncUpdateInterval_;
+    // publish coalescing, see ICTSync::setPublishCoalescing
+    std::chrono::milliseconds publishCoalesceWindow_ = std::chrono::milliseconds(0);
+    int publishMaxBatch_ = 0;
+    ndn::scheduler::ScopedEventId publishCoalesceEvent_;
+    std::chrono::milliseconds suppressionMaxDelay_ = std::chrono::milliseconds(0);
+    ndn::scheduler::ScopedEventId syncInterestEvent_;
+    bool isSyncInterestScheduled_ = false;
+    // the local state version when a covering sync interest was last heard,
+    // and when
+    uint64_t overheardVersion_ = ~0ULL;
+    time::steady_clock::time_point overheardTime_;
     std::chrono::milliseconds nextInterestTs_;
     OnReceivedSyncState onReceivedSyncState_;
     OnInitialized onInitialized_;
@@ -439,17 +1170,59 @@ private:
     int sessionNo_;
     int initialPreviousSequenceNo_;
     int sequenceNo_;
+    // the local sequence number in digestTree_. It is less than sequenceNo_
+    // while publishes are being coalesced.
+    int publishedSequenceNo_;
     InterestList pendingInterests_;
     bool enabled_;
     ScopedPendingInterestHandle lastInterestId_;
     RegisteredPrefixHandle broadcastPrefixRegId_;
+    // the greatest sequence number seen for each session of
+    // outgoingDiscoveryBatches_
     std::map<int, int> outgoingDiscoveryInterests_;
+    // each discovery interest in flight or waiting to be expressed again,
+    // by interest name
+    std::map<Name, DiscoveryBatch> outgoingDiscoveryBatches_;
+    std::map<uint32_t, AbandonedSession> abandonedDiscoverySessions_;
     bool isDiscovery_;
     bool noData_;
-    std::string lastSentDigest_;
-    unique_ptr<ndn::Scheduler> scheduler_;            // scheduler
+    StateEncoding stateEncoding_ = STATE_ENCODING_TEXT;
+    ContentFormat contentFormat_ = CONTENT_FORMAT_PROTOBUF;
+    // states with a larger name component go in ApplicationParameters. 0 for
+    // never.
+    size_t parametersThreshold_ = 0;
+    // fingerprint and root size of the state in the last sync interest sent.
+    // lastSentRootSize_ is 0 until the first one is sent.
+    uint64_t lastSentFingerprint_ = 0;
+    size_t lastSentRootSize_ = 0;
+    // shared with the other groups of manager_, if any
+    std::shared_ptr<ndn::Scheduler> scheduler_;
+    ICTSyncManager* manager_ = nullptr;
+    uint64_t groupId_ = 0;
+    // when the latest checkForUpdate timer scheduled with manager_ is due
+    TimerWheel::Clock::time_point checkForUpdateDue_;
+    LruCache<DiffCacheKey, std::shared_ptr<DiffResult>, DiffCacheKeyHash> diffCache_;
+    // Signed Data by name. It only holds Data made from local state version
+    // signedDataVersion_, and is cleared when the state changes.
+    LruCache<Name, std::shared_ptr<const Data>> signedDataCache_;
+    uint64_t signedDataVersion_ = 0;
+    // incremented by invalidateSignedData
+    uint64_t signedDataGeneration_ = 0;
+    std::shared_ptr<SigningPool> signingPool_;
+    LruCache<uint64_t, std::shared_ptr<const SegmentedSnapshot>> segmentedSnapshots_;
+    std::unique_ptr<SnapshotFetch> snapshotFetch_;
+    Statistics statistics_;
   };
 
+  /**
+   * Use an Impl created and initialized by ICTSyncManager.
+   */
+  explicit
+  ICTSync(const std::shared_ptr<Impl>& impl)
+  : impl_(impl)
+  {
+  }
+
   std::shared_ptr<Impl> impl_;
 };
 
@@ -0,0 +1,150 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_LRU_CACHE_HPP
+#define NDN_ICT_LRU_CACHE_HPP
+
+#include <stddef.h>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace ict {
+
+/**
+ * A map holding at most a fixed number of entries. When it is full, insert
+ * evicts the least recently used entry, where find and insert count as a use.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  explicit
+  LruCache(size_t capacity)
+  : capacity_(capacity)
+  {
+  }
+
+  /**
+   * Find the entry for key and mark it as the most recently used.
+   * @return A pointer to the value, valid until the next insert or clear, or
+   * null if not found.
+   */
+  Value*
+  find(const Key& key)
+  {
+    auto entry = index_.find(key);
+    if (entry == index_.end())
+      return nullptr;
+
+    entries_.splice(entries_.begin(), entries_, entry->second);
+    return &entry->second->second;
+  }
+
+  /**
+   * Set the value for key, replacing any existing value, and mark it as the
+   * most recently used. If the cache is full, first evict the least recently
+   * used entry.
+   * @return A pointer to the stored value.
+   */
+  Value*
+  insert(const Key& key, Value value)
+  {
+    auto entry = index_.find(key);
+    if (entry != index_.end()) {
+      entry->second->second = std::move(value);
+      entries_.splice(entries_.begin(), entries_, entry->second);
+      return &entry->second->second;
+    }
+
+    if (capacity_ == 0)
+      return nullptr;
+    if (index_.size() >= capacity_)
+      evict();
+
+    entries_.emplace_front(key, std::move(value));
+    index_[key] = entries_.begin();
+    return &entries_.front().second;
+  }
+
+  /**
+   * Remove the entry for key, if any.
+   */
+  void
+  erase(const Key& key)
+  {
+    auto entry = index_.find(key);
+    if (entry == index_.end())
+      return;
+
+    entries_.erase(entry->second);
+    index_.erase(entry);
+  }
+
+  /**
+   * Remove the least recently used entry. The cache must not be empty.
+   */
+  void
+  evict()
+  {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+
+  void
+  clear()
+  {
+    index_.clear();
+    entries_.clear();
+  }
+
+  size_t
+  size() const { return index_.size(); }
+
+  bool
+  empty() const { return index_.empty(); }
+
+  size_t
+  getCapacity() const { return capacity_; }
+
+  /**
+   * Set the maximum number of entries, evicting the least recently used ones
+   * if there are more.
+   */
+  void
+  setCapacity(size_t capacity)
+  {
+    capacity_ = capacity;
+    while (index_.size() > capacity_)
+      evict();
+  }
+
+private:
+  typedef std::list<std::pair<Key, Value>> EntryList;
+
+  // most recently used first
+  EntryList entries_;
+  std::unordered_map<Key, typename EntryList::iterator, Hash> index_;
+  size_t capacity_;
+};
+
+}
+
+#endif
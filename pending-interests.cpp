@@ -17,7 +17,7 @@
  *    limitations under the License.
  */
 
-//#include <algorithm>
+#include <algorithm>
 #include <chrono>
 #include <ndn-cxx/util/logger.hpp>
 #include "pending-interests.hpp"
@@ -30,16 +30,125 @@ using namespace ndn;
 
 namespace ict {
 
-InterestList::Impl::Impl()  
+// estimated bytes used per entry besides the interest packet and parsed
+// state: the Entry, PendingInterest and hash table nodes
+static const size_t ENTRY_OVERHEAD = 256;
+
+InterestList::Impl::Impl()
+  : nextId_(0), bytes_(0), capacity_(DEFAULT_CAPACITY),
+    byteBudget_(DEFAULT_BYTE_BUDGET), policy_(EVICT_OLDEST), evictionCount_(0)
 {
 }
 
+void
+InterestList::Impl::setLimits(size_t capacity, size_t byteBudget, EvictionPolicy policy)
+{
+  capacity_ = capacity;
+  byteBudget_ = byteBudget;
+  if (policy != policy_) {
+    policy_ = policy;
+    byExpiry_.clear();
+    if (policy_ == EVICT_SOONEST_TIMEOUT) {
+      for (const Entry& entry : interests_)
+        byExpiry_.insert(std::make_pair(entry.expiry, entry.id));
+    }
+  }
+  evict();
+}
 
 void
-InterestList::Impl::storeInterest(const Interest& interest)
+InterestList::Impl::evict()
+{
+  while (!interests_.empty() &&
+         ((capacity_ > 0 && byId_.size() > capacity_) ||
+          (byteBudget_ > 0 && bytes_ > byteBudget_))) {
+    uint64_t id = policy_ == EVICT_SOONEST_TIMEOUT ?
+      byExpiry_.begin()->second : interests_.front().id;
+    NDN_LOG_DEBUG("Evicting pending interest " << byId_[id]->interest->getName() <<
+                  ", table size " << byId_.size() << ", bytes " << bytes_);
+    remove(id);
+    ++evictionCount_;
+  }
+}
+
+
+bool
+InterestList::Impl::storeInterest
+  (const Interest& interest, uint64_t stateVersion,
+   const std::shared_ptr<const ICTVectorState::RemoteState>& remoteState)
 {
-  interests_.push_back(std::shared_ptr<PendingInterest>
-    (new PendingInterest(interest)));
+  TimerWheel::Clock::time_point expiry = TimerWheel::Clock::time_point::max();
+  if (interest.getInterestLifetime().count() >= 0)
+    expiry = TimerWheel::Clock::now() +
+      std::chrono::milliseconds(interest.getInterestLifetime().count());
+
+  auto sameName = byName_.find(interest.getName());
+  if (sameName != byName_.end()) {
+    // Peers with the same state send the same name. Keep one entry so that
+    // it is diffed and answered once.
+    Entry& entry = *byId_[sameName->second];
+    ++entry.interest->duplicateCount_;
+    if (expiry > entry.expiry) {
+      // the earlier timer is ignored when it fires
+      if (policy_ == EVICT_SOONEST_TIMEOUT) {
+        byExpiry_.erase(std::make_pair(entry.expiry, entry.id));
+        byExpiry_.insert(std::make_pair(expiry, entry.id));
+      }
+      entry.expiry = expiry;
+      timeouts_.schedule(entry.id, expiry);
+    }
+    return true;
+  }
+
+  uint64_t id = nextId_++;
+  std::shared_ptr<PendingInterest> pendingInterest
+    (new PendingInterest(interest, stateVersion, remoteState));
+  size_t bytes = interest.wireEncode().size() + ENTRY_OVERHEAD;
+  if (remoteState)
+    bytes += (remoteState->sessions.capacity() + remoteState->sequences.capacity()) *
+      sizeof(uint32_t);
+  interests_.push_back(Entry{id, pendingInterest, expiry, bytes});
+  byId_[id] = std::prev(interests_.end());
+  byName_[interest.getName()] = id;
+  bytes_ += bytes;
+  if (policy_ == EVICT_SOONEST_TIMEOUT)
+    byExpiry_.insert(std::make_pair(expiry, id));
+
+  if (expiry != TimerWheel::Clock::time_point::max())
+    timeouts_.schedule(id, expiry);
+  evict();
+  return false;
+}
+
+void
+InterestList::Impl::remove(uint64_t id)
+{
+  auto entry = byId_.find(id);
+  if (entry == byId_.end())
+    // already removed, and the timer fired later
+    return;
+
+  byName_.erase(entry->second->interest->getName());
+  bytes_ -= entry->second->bytes;
+  if (policy_ == EVICT_SOONEST_TIMEOUT)
+    byExpiry_.erase(std::make_pair(entry->second->expiry, id));
+  interests_.erase(entry->second);
+  byId_.erase(entry);
+}
+
+void
+InterestList::Impl::removeTimedOut()
+{
+  TimerWheel::Clock::time_point now = TimerWheel::Clock::now();
+  expired_.clear();
+  timeouts_.advance(now, expired_);
+  for (uint64_t id : expired_) {
+    auto entry = byId_.find(id);
+    // skip the ids already removed, and the earlier timers of aggregated
+    // interests
+    if (entry != byId_.end() && entry->second->expiry <= now)
+      remove(id);
+  }
 }
 
 void
@@ -48,23 +157,16 @@ InterestList::Impl::getInterestsForName(const Name& name,
                                         bool remove)
 {
   pendingInterests.clear();
+  removeTimedOut();
 
-  // Remove timed-out interests as we add results.
-  // Go backwards through the list so we can erase entries.
-  long now = std::chrono::duration_cast< std::chrono::milliseconds >(
-                                                                     std::chrono::system_clock::now().time_since_epoch()
-                                                                                          ).count();
-  for (int i = (int)interests_.size() - 1; i >= 0; --i) {
-    if (interests_[i]->isTimedOut(now)) {
-      interests_.erase(interests_.begin() + i);
-    }
-    else if (interests_[i]->getInterest().getName().equals(name))
-      {
-        pendingInterests.push_back(interests_[i]);
-        if (remove)
-          interests_.erase(interests_.begin() + i);
-      }
-  }
+  auto sameName = byName_.find(name);
+  if (sameName == byName_.end())
+    return;
+
+  uint64_t id = sameName->second;
+  pendingInterests.push_back(byId_[id]->interest);
+  if (remove)
+    this->remove(id);
 }
 
 void
@@ -73,29 +175,29 @@ InterestList::Impl::getInterestsWithPrefix(const Name& prefix,
                                            bool remove)
 {
   pendingInterests.clear();
-
-  // Remove timed-out interests as we add results.
-  // Go backwards through the list so we can erase entries.
-  long now = std::chrono::duration_cast< std::chrono::milliseconds >(
-                                                                     std::chrono::system_clock::now().time_since_epoch()
-                                                                     ).count();
-  for (int i = (int)interests_.size() - 1; i >= 0; --i) {
-    if (interests_[i]->isTimedOut(now)) {
-      interests_.erase(interests_.begin() + i);
-    }
-    else if (prefix.isPrefixOf(interests_[i]->getInterest().getName()))
-      {
-        pendingInterests.push_back(interests_[i]);
-        if (remove)
-          interests_.erase(interests_.begin() + i);
+  removeTimedOut();
+
+  // newest first. Removing the entry before next leaves next valid.
+  EntryList::iterator next = interests_.end();
+  while (next != interests_.begin()) {
+    EntryList::iterator entry = std::prev(next);
+    if (prefix.isPrefixOf(entry->interest->getName())) {
+      pendingInterests.push_back(entry->interest);
+      if (remove) {
+        this->remove(entry->id);
+        continue;
       }
+    }
+    next = entry;
   }
 }
 
 
 InterestList::PendingInterest::PendingInterest
-  (const Interest& interest)
-    : interest_(interest), name_(interest.getName())
+  (const Interest& interest, uint64_t stateVersion,
+   const std::shared_ptr<const ICTVectorState::RemoteState>& remoteState)
+    : interest_(interest), name_(interest.getName()), stateVersion_(stateVersion),
+      remoteState_(remoteState)
 {
 
   time_start_ = std::chrono::duration_cast< std::chrono::milliseconds >(
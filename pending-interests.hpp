@@ -20,8 +20,13 @@
 #define ICT_PENDING_INTERESTS_HPP
 
 #include <vector>
+#include <list>
+#include <set>
+#include <unordered_map>
 #include <ndn-cxx/name.hpp>
 #include <ndn-cxx/interest.hpp>
+#include "ict-vector-state.hpp"
+#include "timer-wheel.hpp"
 
 using namespace ndn;
 namespace ict {
@@ -45,7 +50,8 @@ namespace ict {
        * packet to the face.
        */
       PendingInterest
-      (const Interest& interest);
+      (const Interest& interest, uint64_t stateVersion = 0,
+       const std::shared_ptr<const ICTVectorState::RemoteState>& remoteState = nullptr);
       
       /**
        * Return the interest given to the constructor. You must not modify this
@@ -59,6 +65,27 @@ namespace ict {
       {
         return name_;
       }
+
+      /**
+       * Get the version of the local state when the interest was stored.
+       * The interest had nothing to be answered with at that version.
+       */
+      uint64_t
+      getStateVersion() const { return stateVersion_; }
+
+      /**
+       * Get the parsed state of the interest, or null if not given.
+       */
+      const std::shared_ptr<const ICTVectorState::RemoteState>&
+      getRemoteState() const { return remoteState_; }
+
+      /**
+       * Get the number of interests with the same name which arrived after
+       * this one and were aggregated into it. Answering this interest
+       * answers them too.
+       */
+      size_t
+      getDuplicateCount() const { return duplicateCount_; }
     public:
       
       /**
@@ -87,11 +114,30 @@ namespace ict {
     private:
       const Interest interest_;
       const Name name_;
+      uint64_t stateVersion_;
+      std::shared_ptr<const ICTVectorState::RemoteState> remoteState_;
       long time_start_;
       long timeout_ms_; /**< The time when the
                                               * interest times out in ms or 0 for no timeout. */
+      size_t duplicateCount_ = 0;
+
+      friend class InterestList;
     };
 
+    /**
+     * Which stored interest to evict when the table is over its capacity or
+     * byte budget.
+     */
+    enum EvictionPolicy {
+      // the interest stored first
+      EVICT_OLDEST = 0,
+      // the interest which would time out first
+      EVICT_SOONEST_TIMEOUT = 1
+    };
+
+    // default limits, which hold thousands of distinct sync states
+    static const size_t DEFAULT_CAPACITY = 8192;
+    static const size_t DEFAULT_BYTE_BUDGET = 32 * 1024 * 1024;
 
     InterestList():impl_(new Impl()){}
 
@@ -119,7 +165,9 @@ namespace ict {
   /**
    * Store an interest from an OnInterest callback in the internal pending
    * interest table (normally because there is no Data packet available yet to
-   * satisfy the interest). add(data) will check if the added Data packet
+   * satisfy the interest). An interest with the same name as a stored one is
+   * aggregated into it: the stored entry counts it as a duplicate and keeps
+   * the later of their timeouts. add(data) will check if the added Data packet
    * satisfies any pending interest and send it through the face.
    * Because this modifies the internal tables, you should call this on the same
    * thread as processEvents, which can also modify the tables.
@@ -134,6 +182,21 @@ namespace ict {
   {
     impl_->storeInterest(interest);
   }
+
+  /**
+   * Store an interest as above, with the local state version at which it
+   * was evaluated and its parsed state, so that it can later be answered by
+   * looking only at what changed since (see ICTVectorState::getDiffSince).
+   * @return True if the interest was aggregated into a stored interest with
+   * the same name.
+   */
+  bool
+  storeInterest
+    (const Interest& interest, uint64_t stateVersion,
+     const std::shared_ptr<const ICTVectorState::RemoteState>& remoteState)
+  {
+    return impl_->storeInterest(interest, stateVersion, remoteState);
+  }
   /**
    * Remove timed-out pending interests, then for each pending interest which
    * matches according to Interest.matchesName(name), append the PendingInterest
@@ -153,6 +216,41 @@ namespace ict {
   {
     impl_->getInterestsForName(name, pendingInterests);
   }
+
+  /**
+   * Get the number of stored interests, including timed-out ones which were
+   * not removed yet.
+   */
+  size_t
+  size() const { return impl_->size(); }
+
+  /**
+   * Get the approximate number of bytes used by the stored interests and
+   * their parsed states.
+   */
+  size_t
+  getMemoryUsage() const { return impl_->getMemoryUsage(); }
+
+  /**
+   * Limit the table. When storing an interest leaves it with more than
+   * capacity interests or more than byteBudget bytes (see getMemoryUsage),
+   * interests are evicted according to policy until it is within both. The
+   * defaults are DEFAULT_CAPACITY, DEFAULT_BYTE_BUDGET and EVICT_OLDEST.
+   * @param capacity The maximum number of interests, or 0 for no limit.
+   * @param byteBudget The maximum number of bytes, or 0 for no limit.
+   */
+  void
+  setLimits(size_t capacity, size_t byteBudget, EvictionPolicy policy = EVICT_OLDEST)
+  {
+    impl_->setLimits(capacity, byteBudget, policy);
+  }
+
+  /**
+   * Get the number of interests evicted to stay within the limits.
+   */
+  uint64_t
+  getEvictionCount() const { return impl_->getEvictionCount(); }
+
 private:
   /**
    * MemoryContentCache::Impl does the work of MemoryContentCache. It is a
@@ -169,9 +267,10 @@ private:
       // void
       // add(const Data& data);
 
-      void
+      bool
       storeInterest
-      (const Interest& interest);//, Face& face);
+      (const Interest& interest, uint64_t stateVersion = 0,
+       const std::shared_ptr<const ICTVectorState::RemoteState>& remoteState = nullptr);//, Face& face);
       
       void
       getInterestsForName
@@ -182,8 +281,63 @@ private:
       getInterestsWithPrefix
       (const Name& prefix,
        std::vector<std::shared_ptr<const PendingInterest> >& pendingInterests, bool remove=false);
+
+      size_t
+      size() const { return byId_.size(); }
+
+      size_t
+      getMemoryUsage() const { return bytes_; }
+
+      void
+      setLimits(size_t capacity, size_t byteBudget, EvictionPolicy policy);
+
+      uint64_t
+      getEvictionCount() const { return evictionCount_; }
+
     private:
-      std::vector<std::shared_ptr<const PendingInterest> > interests_;
+      struct Entry {
+        uint64_t id;
+        std::shared_ptr<PendingInterest> interest;
+        // the latest timeout of the aggregated interests
+        TimerWheel::Clock::time_point expiry;
+        // the part of bytes_ used by this entry
+        size_t bytes;
+      };
+      typedef std::list<Entry> EntryList;
+      typedef std::set<std::pair<TimerWheel::Clock::time_point, uint64_t> > ExpiryIndex;
+
+      /**
+       * Evict interests according to policy_ until the table is within
+       * capacity_ and byteBudget_.
+       */
+      void
+      evict();
+
+      /**
+       * Remove the interests whose lifetime has passed.
+       */
+      void
+      removeTimedOut();
+
+      void
+      remove(uint64_t id);
+
+      // in arrival order
+      EntryList interests_;
+      std::unordered_map<uint64_t, EntryList::iterator> byId_;
+      // the id of the interest with each name
+      std::unordered_map<Name, uint64_t> byName_;
+      // (expiry, id) of each interest, only kept for EVICT_SOONEST_TIMEOUT
+      ExpiryIndex byExpiry_;
+      TimerWheel timeouts_;
+      uint64_t nextId_;
+      size_t bytes_;
+      size_t capacity_;
+      size_t byteBudget_;
+      EvictionPolicy policy_;
+      uint64_t evictionCount_;
+      // scratch space for removeTimedOut
+      std::vector<uint64_t> expired_;
     };
 
   std::shared_ptr<Impl> impl_;
@@ -0,0 +1,113 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#include <ndn-cxx/util/logger.hpp>
+#include "signing-pool.hpp"
+
+NDN_LOG_INIT(ict.SigningPool);
+
+using namespace std;
+using namespace ndn;
+
+namespace ict {
+
+SigningPool::SigningPool(size_t threadCount, boost::asio::io_service& ioService,
+                         const KeyChainFactory& makeKeyChain)
+  : ioService_(ioService), queueDepth_(0), stopping_(false)
+{
+  if (threadCount == 0)
+    threadCount = 1;
+  // make all the KeyChains before starting a thread, so that a failure
+  // leaves nothing to stop
+  for (size_t i = 0; i < threadCount; ++i) {
+    workers_.emplace_back(new Worker());
+    workers_.back()->keyChain = makeKeyChain();
+  }
+  for (auto& worker : workers_)
+    worker->thread = std::thread(&SigningPool::run, this, std::ref(*worker));
+}
+
+SigningPool::~SigningPool()
+{
+  stopping_ = true;
+  for (auto& worker : workers_) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+    }
+    worker->ready.notify_all();
+  }
+  for (auto& worker : workers_)
+    worker->thread.join();
+}
+
+SigningPool::KeyChainFactory
+SigningPool::getKeyChainFactory(KeyChain& keyChain)
+{
+  std::string pibLocator = keyChain.getPib().getPibLocator();
+  std::string tpmLocator = keyChain.getTpm().getTpmLocator();
+  return [pibLocator, tpmLocator] {
+    return std::unique_ptr<KeyChain>(new KeyChain(pibLocator, tpmLocator));
+  };
+}
+
+void
+SigningPool::sign(const std::shared_ptr<Data>& data,
+                  const security::SigningInfo& signingInfo, const OnSigned& onSigned)
+{
+  Worker& worker = *workers_[std::hash<Name>()(data->getName()) % workers_.size()];
+  ++queueDepth_;
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(Job{data, signingInfo, onSigned});
+  }
+  worker.ready.notify_one();
+}
+
+void
+SigningPool::run(Worker& worker)
+{
+  KeyChain& keyChain = *worker.keyChain;
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(worker.mutex);
+      worker.ready.wait(lock, [&] { return stopping_ || !worker.jobs.empty(); });
+      if (stopping_)
+        return;
+      job = std::move(worker.jobs.front());
+      worker.jobs.pop_front();
+    }
+
+    try {
+      keyChain.sign(*job.data, job.signingInfo);
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_ERROR("Failed to sign " << job.data->getName() << ": " << e.what());
+      --queueDepth_;
+      continue;
+    }
+    --queueDepth_;
+    // posts from one thread run in order, which keeps the order per name
+    ioService_.post(std::bind(job.onSigned, job.data));
+  }
+}
+
+}
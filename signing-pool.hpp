@@ -0,0 +1,123 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_SIGNING_POOL_HPP
+#define NDN_ICT_SIGNING_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+
+namespace ict {
+
+/**
+ * A SigningPool signs Data on worker threads so that slow signatures do not
+ * hold up the io thread. Each worker has its own KeyChain, made by a
+ * KeyChainFactory, since a KeyChain must not be shared between threads.
+ * The signed Data is handed back on the io_service. All Data with the same
+ * name go to the same worker, so they are handed back in the order they were
+ * given. Data which fails to sign is dropped, with an error logged.
+ */
+class SigningPool {
+public:
+  typedef std::function<void(const std::shared_ptr<ndn::Data>&)> OnSigned;
+
+  /**
+   * Make the KeyChain of one worker. It is called on the thread which
+   * creates the SigningPool.
+   */
+  typedef std::function<std::unique_ptr<ndn::KeyChain>()> KeyChainFactory;
+
+  /**
+   * Start the worker threads.
+   * @param threadCount The number of workers, at least 1.
+   * @param ioService Where onSigned is called.
+   * @param makeKeyChain Makes the KeyChain of each worker.
+   * @throw The exceptions of makeKeyChain.
+   */
+  SigningPool(size_t threadCount, boost::asio::io_service& ioService,
+              const KeyChainFactory& makeKeyChain);
+
+  /**
+   * Get a KeyChainFactory which opens the PIB and TPM of keyChain. An
+   * in-memory PIB or TPM cannot be opened again, so with those you must give
+   * your own factory which puts the signing keys in each KeyChain.
+   */
+  static KeyChainFactory
+  getKeyChainFactory(ndn::KeyChain& keyChain);
+
+  /**
+   * Stop the workers. Data not signed yet are dropped.
+   */
+  ~SigningPool();
+
+  /**
+   * Queue data to be signed with signingInfo, then call onSigned with it on
+   * the io_service.
+   */
+  void
+  sign(const std::shared_ptr<ndn::Data>& data,
+       const ndn::security::SigningInfo& signingInfo, const OnSigned& onSigned);
+
+  /**
+   * Get the number of Data queued or being signed.
+   */
+  size_t
+  getQueueDepth() const { return queueDepth_; }
+
+  size_t
+  getThreadCount() const { return workers_.size(); }
+
+private:
+  struct Job {
+    std::shared_ptr<ndn::Data> data;
+    ndn::security::SigningInfo signingInfo;
+    OnSigned onSigned;
+  };
+
+  struct Worker {
+    std::unique_ptr<ndn::KeyChain> keyChain;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Job> jobs;
+    std::thread thread;
+  };
+
+  void
+  run(Worker& worker);
+
+  boost::asio::io_service& ioService_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> queueDepth_;
+  std::atomic<bool> stopping_;
+};
+
+}
+
+#endif
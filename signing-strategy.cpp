@@ -0,0 +1,106 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#include <stdexcept>
+#include <ndn-cxx/security/signing-helpers.hpp>
+#include "signing-strategy.hpp"
+
+using namespace std;
+using namespace ndn;
+
+namespace ict {
+
+SigningStrategy::SigningStrategy(const Name& certificateName)
+  : certificateName_(certificateName)
+{
+  for (int kind = 0; kind < SYNC_DATA_KIND_COUNT; ++kind)
+    modes_[kind] = SIGNING_CERTIFICATE;
+  update();
+}
+
+void
+SigningStrategy::setMode(SyncDataKind kind, SigningMode mode)
+{
+  if (mode == SIGNING_HMAC && hmacKey_.empty())
+    throw std::invalid_argument("SigningStrategy: set the HMAC key before using SIGNING_HMAC");
+  modes_[kind] = mode;
+  update();
+}
+
+void
+SigningStrategy::setMode(SigningMode mode)
+{
+  for (int kind = 0; kind < SYNC_DATA_KIND_COUNT; ++kind)
+    setMode((SyncDataKind)kind, mode);
+}
+
+void
+SigningStrategy::setHmacKey(const std::string& hmacKey)
+{
+  hmacKey_ = hmacKey;
+  update();
+}
+
+void
+SigningStrategy::setCertificateName(const Name& certificateName)
+{
+  certificateName_ = certificateName;
+  update();
+}
+
+const char*
+SigningStrategy::getModeName(SigningMode mode)
+{
+  switch (mode) {
+  case SIGNING_CERTIFICATE:
+    return "certificate";
+  case SIGNING_DIGEST_SHA256:
+    return "sha256";
+  case SIGNING_HMAC:
+    return "hmac";
+  default:
+    return "unknown";
+  }
+}
+
+void
+SigningStrategy::update()
+{
+  for (int kind = 0; kind < SYNC_DATA_KIND_COUNT; ++kind) {
+    switch (modes_[kind]) {
+    case SIGNING_DIGEST_SHA256:
+      signingInfos_[kind] = security::signingWithSha256();
+      break;
+    case SIGNING_HMAC:
+      signingInfos_[kind] = security::SigningInfo();
+      signingInfos_[kind].setSigningHmacKey(hmacKey_);
+      break;
+    default:
+      if (certificateName_.empty())
+        signingInfos_[kind] = security::SigningInfo();
+      else
+        signingInfos_[kind] = security::signingByCertificate(certificateName_);
+      break;
+    }
+  }
+}
+
+}
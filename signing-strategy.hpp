@@ -0,0 +1,132 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_SIGNING_STRATEGY_HPP
+#define NDN_ICT_SIGNING_STRATEGY_HPP
+
+#include <string>
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+
+namespace ict {
+
+/**
+ * How a kind of sync Data is signed. Certificate signing is the default.
+ * The cheaper modes only make sense where the receivers trust the network
+ * (digest) or share a group key (HMAC), and their validators must accept
+ * them.
+ */
+enum SigningMode {
+  // with certificateName, or the default identity if it is empty
+  SIGNING_CERTIFICATE = 0,
+  // DigestSha256: integrity only, no signature
+  SIGNING_DIGEST_SHA256 = 1,
+  // HMAC-SHA256 with the group key given to setHmacKey
+  SIGNING_HMAC = 2
+};
+
+/**
+ * The kinds of Data an ICTSync sends, which may be signed differently.
+ */
+enum SyncDataKind {
+  // answer to a sync interest
+  SYNC_DATA_SYNC = 0,
+  // the full state, answering the interest of a newcomer
+  SYNC_DATA_NEWCOMER = 1,
+  // answer to a DISCOVERY interest
+  SYNC_DATA_DISCOVERY = 2,
+  SYNC_DATA_KIND_COUNT = 3
+};
+
+/**
+ * A SigningStrategy holds the SigningMode for each SyncDataKind and signs
+ * Data accordingly.
+ */
+class SigningStrategy {
+public:
+  /**
+   * Create a SigningStrategy which uses SIGNING_CERTIFICATE for every kind.
+   * @param certificateName The certificate to sign with, or an empty Name for
+   * the default identity of the KeyChain.
+   */
+  explicit
+  SigningStrategy(const ndn::Name& certificateName = ndn::Name());
+
+  /**
+   * Set the mode for one kind of Data.
+   * @throw std::invalid_argument if mode is SIGNING_HMAC and no HMAC key
+   * was set.
+   */
+  void
+  setMode(SyncDataKind kind, SigningMode mode);
+
+  /**
+   * Set the mode for all kinds of Data.
+   * @throw std::invalid_argument as setMode.
+   */
+  void
+  setMode(SigningMode mode);
+
+  SigningMode
+  getMode(SyncDataKind kind) const { return modes_[kind]; }
+
+  /**
+   * Set the group key for SIGNING_HMAC.
+   * @param hmacKey The base64 encoded key.
+   */
+  void
+  setHmacKey(const std::string& hmacKey);
+
+  void
+  setCertificateName(const ndn::Name& certificateName);
+
+  /**
+   * Sign data as the given kind.
+   */
+  void
+  sign(ndn::KeyChain& keyChain, ndn::Data& data, SyncDataKind kind) const
+  {
+    keyChain.sign(data, signingInfos_[kind]);
+  }
+
+  /**
+   * Get the SigningInfo which sign uses for kind.
+   */
+  const ndn::security::SigningInfo&
+  getSigningInfo(SyncDataKind kind) const { return signingInfos_[kind]; }
+
+  static const char*
+  getModeName(SigningMode mode);
+
+private:
+  // rebuild signingInfos_ from the settings
+  void
+  update();
+
+  SigningMode modes_[SYNC_DATA_KIND_COUNT];
+  ndn::Name certificateName_;
+  std::string hmacKey_;
+  ndn::security::SigningInfo signingInfos_[SYNC_DATA_KIND_COUNT];
+};
+
+}
+
+#endif
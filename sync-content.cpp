@@ -0,0 +1,385 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#include <limits.h>
+#include <stdexcept>
+#include <google/protobuf/io/coded_stream.h>
+#include "sync-state.pb.h"
+#include "ict-vector-state.hpp"
+#include "sync-content.hpp"
+
+using namespace std;
+using namespace ndn;
+
+namespace ict {
+
+namespace {
+
+// The TLV-TYPE and TLV-LENGTH numbers of NDN-TLV: one byte below 253,
+// otherwise a marker byte and 2, 4 or 8 bytes in network order.
+void
+appendVarNumber(std::string& out, uint64_t number)
+{
+  if (number < 253) {
+    out.push_back((char)number);
+    return;
+  }
+
+  int size;
+  if (number <= 0xFFFF) {
+    out.push_back((char)253);
+    size = 2;
+  }
+  else if (number <= 0xFFFFFFFF) {
+    out.push_back((char)254);
+    size = 4;
+  }
+  else {
+    out.push_back((char)255);
+    size = 8;
+  }
+  for (int i = size - 1; i >= 0; --i)
+    out.push_back((char)(number >> (8 * i)));
+}
+
+bool
+readVarNumber(const uint8_t*& position, const uint8_t* end, uint64_t& number)
+{
+  if (position >= end)
+    return false;
+
+  uint8_t first = *position++;
+  if (first < 253) {
+    number = first;
+    return true;
+  }
+
+  size_t size = first == 253 ? 2 : (first == 254 ? 4 : 8);
+  if ((size_t)(end - position) < size)
+    return false;
+  number = 0;
+  for (size_t i = 0; i < size; ++i)
+    number = (number << 8) | *position++;
+  return true;
+}
+
+// A NonNegativeInteger is 1, 2, 4 or 8 bytes in network order.
+void
+appendNonNegativeInteger(std::string& out, uint32_t type, uint64_t value)
+{
+  int size = value <= 0xFF ? 1 : (value <= 0xFFFF ? 2 : (value <= 0xFFFFFFFF ? 4 : 8));
+  appendVarNumber(out, type);
+  appendVarNumber(out, size);
+  for (int i = size - 1; i >= 0; --i)
+    out.push_back((char)(value >> (8 * i)));
+}
+
+bool
+readNonNegativeInteger(const uint8_t* value, size_t size, uint64_t& number)
+{
+  if (size != 1 && size != 2 && size != 4 && size != 8)
+    return false;
+
+  number = 0;
+  for (size_t i = 0; i < size; ++i)
+    number = (number << 8) | value[i];
+  return true;
+}
+
+void
+appendBytes(std::string& out, uint32_t type, const uint8_t* value, size_t size)
+{
+  appendVarNumber(out, type);
+  appendVarNumber(out, size);
+  out.append((const char*)value, size);
+}
+
+// the ContentVersion element which starts CONTENT_FORMAT_TLV content
+std::string
+makeVersionElement()
+{
+  std::string element;
+  appendNonNegativeInteger(element, SyncContentEncoder::TLV_CONTENT_VERSION,
+                           SyncContentEncoder::TLV_FORMAT_VERSION);
+  return element;
+}
+
+const std::string VERSION_ELEMENT = makeVersionElement();
+
+// Sessions and sequences are ints in ICTVectorState and are written as
+// their conversion to uint64_t, so a negative session is sign extended.
+// Sequences are not negative.
+bool
+isStateSession(uint64_t session)
+{
+  return session <= (uint64_t)INT_MAX || session >= (uint64_t)(int64_t)INT_MIN;
+}
+
+bool
+isStateSequence(uint64_t sequence)
+{
+  return sequence <= (uint64_t)INT_MAX;
+}
+
+}
+
+SyncContentEncoder::SyncContentEncoder(ContentFormat format)
+  : format_(format), size_(0), entriesSize_(0), lastEntrySize_(0)
+{
+  if (format_ == CONTENT_FORMAT_PROTOBUF)
+    message_.reset(new Sync::SyncStateMsg());
+}
+
+SyncContentEncoder::~SyncContentEncoder()
+{
+}
+
+void
+SyncContentEncoder::add
+  (const std::string& name, SyncAction action, uint64_t session, uint64_t sequence,
+   const uint8_t* applicationInfo, size_t applicationInfoSize)
+{
+  ++size_;
+  if (format_ == CONTENT_FORMAT_TLV) {
+    appendTlvEntry(entries_, (const uint8_t*)name.data(), name.size(), action,
+                   session, sequence, applicationInfo, applicationInfoSize);
+    lastEntrySize_ = entries_.size() - entriesSize_;
+    entriesSize_ = entries_.size();
+    return;
+  }
+
+  Sync::SyncState* entry = message_->add_ss();
+  if (!name.empty())
+    entry->set_name(name);
+  entry->set_type((Sync::SyncState_ActionType)action);
+  entry->mutable_seqno()->set_seq(sequence);
+  entry->mutable_seqno()->set_session(session);
+  if (applicationInfoSize > 0)
+    entry->set_application_info(applicationInfo, applicationInfoSize);
+
+  // the entry takes its size, a length and a tag byte in the message
+  size_t entrySize = entry->ByteSize();
+  lastEntrySize_ = 1 + google::protobuf::io::CodedOutputStream::VarintSize32(entrySize) +
+    entrySize;
+  entriesSize_ += lastEntrySize_;
+}
+
+void
+SyncContentEncoder::removeLast()
+{
+  if (lastEntrySize_ == 0)
+    throw std::logic_error("SyncContentEncoder::removeLast: no entry to remove");
+
+  --size_;
+  entriesSize_ -= lastEntrySize_;
+  lastEntrySize_ = 0;
+  if (format_ == CONTENT_FORMAT_TLV)
+    entries_.resize(entriesSize_);
+  else
+    message_->mutable_ss()->RemoveLast();
+}
+
+size_t
+SyncContentEncoder::getEncodedSize() const
+{
+  if (format_ == CONTENT_FORMAT_TLV)
+    return VERSION_ELEMENT.size() + entries_.size();
+  return entriesSize_;
+}
+
+ConstBufferPtr
+SyncContentEncoder::encode() const
+{
+  std::shared_ptr<Buffer> buffer(new Buffer(getEncodedSize()));
+  if (format_ == CONTENT_FORMAT_TLV) {
+    std::copy(VERSION_ELEMENT.begin(), VERSION_ELEMENT.end(), buffer->begin());
+    std::copy(entries_.begin(), entries_.end(), buffer->begin() + VERSION_ELEMENT.size());
+  }
+  else if (buffer->size() > 0)
+    message_->SerializeToArray(buffer->data(), buffer->size());
+  return buffer;
+}
+
+void
+SyncContentEncoder::appendTlvEntry
+  (std::string& out, const uint8_t* name, size_t nameSize, SyncAction action,
+   uint64_t session, uint64_t sequence, const uint8_t* applicationInfo,
+   size_t applicationInfoSize)
+{
+  std::string value;
+  if (nameSize > 0)
+    appendBytes(value, TLV_ENTRY_NAME, name, nameSize);
+  if (action != SYNC_ACTION_UPDATE)
+    appendNonNegativeInteger(value, TLV_ENTRY_ACTION, action);
+  appendNonNegativeInteger(value, TLV_ENTRY_SESSION, session);
+  appendNonNegativeInteger(value, TLV_ENTRY_SEQUENCE, sequence);
+  if (applicationInfoSize > 0)
+    appendBytes(value, TLV_ENTRY_APPLICATION_INFO, applicationInfo, applicationInfoSize);
+
+  appendBytes(out, TLV_ENTRY, (const uint8_t*)value.data(), value.size());
+}
+
+SyncContentView::SyncContentView()
+  : begin_(nullptr), end_(nullptr)
+{
+}
+
+SyncContentView::~SyncContentView()
+{
+}
+
+bool
+SyncContentView::parse(const uint8_t* value, size_t size)
+{
+  begin_ = end_ = nullptr;
+  storage_.clear();
+  message_.reset();
+  format_ = CONTENT_FORMAT_PROTOBUF;
+
+  if (Gzip::isCompressed(value, size)) {
+    try {
+      storage_ = Gzip::decompress(std::string((const char*)value, size),
+                                  Gzip::MAX_DECOMPRESSED_SIZE);
+    }
+    catch (const std::exception& e) {
+      storage_.clear();
+      return false;
+    }
+    value = (const uint8_t*)storage_.data();
+    size = storage_.size();
+  }
+
+  if (size > 0 && *value == SyncContentEncoder::TLV_CONTENT_VERSION) {
+    format_ = CONTENT_FORMAT_TLV;
+    return parseTlv(value, value + size);
+  }
+
+  // Otherwise it is a Sync::SyncStateMsg, which starts with 0x0a, the key
+  // of its only field. Its entries are read from the message as is.
+  message_.reset(new Sync::SyncStateMsg());
+  if (!message_->ParseFromArray(value, size)) {
+    message_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool
+SyncContentView::parseTlv(const uint8_t* begin, const uint8_t* end)
+{
+  const uint8_t* position = begin;
+  uint64_t type, length, version;
+  if (!readVarNumber(position, end, type) || !readVarNumber(position, end, length) ||
+      length > (uint64_t)(end - position) ||
+      !readNonNegativeInteger(position, length, version) ||
+      version != SyncContentEncoder::TLV_FORMAT_VERSION)
+    return false;
+
+  begin_ = position + length;
+  end_ = end;
+  return true;
+}
+
+bool
+SyncContentView::decodeMessageEntry(const Sync::SyncStateMsg& message, int& index, Entry& entry)
+{
+  while (index < message.ss_size()) {
+    const Sync::SyncState& state = message.ss(index++);
+    if (!isStateSession(state.seqno().session()) || !isStateSequence(state.seqno().seq()))
+      continue;
+
+    entry = Entry();
+    entry.action_ = (SyncAction)state.type();
+    entry.session_ = state.seqno().session();
+    entry.sequence_ = state.seqno().seq();
+    entry.name_ = (const uint8_t*)state.name().data();
+    entry.nameSize_ = state.name().size();
+    entry.applicationInfo_ = (const uint8_t*)state.application_info().data();
+    entry.applicationInfoSize_ = state.application_info().size();
+    return true;
+  }
+  return false;
+}
+
+bool
+SyncContentView::decodeEntry(const uint8_t*& position, const uint8_t* end, Entry& entry)
+{
+  while (position < end) {
+    uint64_t type, length;
+    if (!readVarNumber(position, end, type) || !readVarNumber(position, end, length) ||
+        length > (uint64_t)(end - position))
+      return false;
+
+    const uint8_t* value = position;
+    const uint8_t* valueEnd = position + length;
+    position = valueEnd;
+    if (type != SyncContentEncoder::TLV_ENTRY)
+      continue;
+
+    entry = Entry();
+    bool hasSession = false;
+    bool hasSequence = false;
+    while (value < valueEnd) {
+      uint64_t elementType, elementLength, number;
+      if (!readVarNumber(value, valueEnd, elementType) ||
+          !readVarNumber(value, valueEnd, elementLength) ||
+          elementLength > (uint64_t)(valueEnd - value))
+        return false;
+
+      switch (elementType) {
+      case SyncContentEncoder::TLV_ENTRY_NAME:
+        entry.name_ = value;
+        entry.nameSize_ = elementLength;
+        break;
+      case SyncContentEncoder::TLV_ENTRY_ACTION:
+        if (!readNonNegativeInteger(value, elementLength, number))
+          return false;
+        entry.action_ = (SyncAction)number;
+        break;
+      case SyncContentEncoder::TLV_ENTRY_SESSION:
+        if (!readNonNegativeInteger(value, elementLength, entry.session_))
+          return false;
+        hasSession = true;
+        break;
+      case SyncContentEncoder::TLV_ENTRY_SEQUENCE:
+        if (!readNonNegativeInteger(value, elementLength, entry.sequence_))
+          return false;
+        hasSequence = true;
+        break;
+      case SyncContentEncoder::TLV_ENTRY_APPLICATION_INFO:
+        entry.applicationInfo_ = value;
+        entry.applicationInfoSize_ = elementLength;
+        break;
+      default:
+        break;
+      }
+      value += elementLength;
+    }
+    if (!hasSession || !hasSequence)
+      return false;
+    if (isStateSession(entry.session_) && isStateSequence(entry.sequence_))
+      return true;
+    // otherwise skip it
+  }
+  return false;
+}
+
+}
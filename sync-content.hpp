@@ -0,0 +1,365 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+/*
+ * Copyright (c) 2018-2022 Hila Ben Abraham and Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version, with the additional exemption that
+ * compiling, linking, and/or using OpenSSL is allowed.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * A copy of the GNU Lesser General Public License is in the file COPYING.
+ */
+
+#ifndef NDN_ICT_SYNC_CONTENT_HPP
+#define NDN_ICT_SYNC_CONTENT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <ndn-cxx/encoding/buffer.hpp>
+
+namespace Sync { class SyncStateMsg; }
+
+namespace ict {
+
+/**
+ * The format of the content of sync, newcomer and discovery Data.
+ */
+enum ContentFormat {
+  // the Sync::SyncStateMsg protobuf message, understood by all versions
+  CONTENT_FORMAT_PROTOBUF = 0,
+  // NDN-TLV entries, see SyncContentEncoder. Receivers tell it apart from
+  // protobuf by its first byte, so it can be enabled once all the peers of
+  // the sync group can read it.
+  CONTENT_FORMAT_TLV = 1
+};
+
+/**
+ * The action of an entry of sync content, with the same values as
+ * Sync::SyncState::ActionType.
+ */
+enum SyncAction {
+  SYNC_ACTION_UPDATE = 0,
+  SYNC_ACTION_DELETE = 1,
+  SYNC_ACTION_OTHER = 2,
+  // the receiver already knows the name of the session
+  SYNC_ACTION_UPDATE_NO_NAME = 3
+};
+
+/**
+ * A SyncContentEncoder collects the entries of a sync Data and writes them as
+ * the value of its Content in a ContentFormat.
+ *
+ * The CONTENT_FORMAT_TLV value is a ContentVersion element followed by one
+ * Entry element per entry. An Entry holds an EntryAction (omitted for
+ * SYNC_ACTION_UPDATE), an EntrySession, an EntrySequence, and optionally an
+ * EntryName with the data prefix URI and an EntryApplicationInfo. Numbers are
+ * NonNegativeIntegers. Unknown elements in an Entry are ignored.
+ */
+class SyncContentEncoder {
+public:
+  static const uint32_t TLV_CONTENT_VERSION = 128;
+  static const uint32_t TLV_ENTRY = 129;
+  static const uint32_t TLV_ENTRY_NAME = 130;
+  static const uint32_t TLV_ENTRY_ACTION = 131;
+  static const uint32_t TLV_ENTRY_SESSION = 132;
+  static const uint32_t TLV_ENTRY_SEQUENCE = 133;
+  static const uint32_t TLV_ENTRY_APPLICATION_INFO = 134;
+  // the value of ContentVersion written by this version
+  static const uint64_t TLV_FORMAT_VERSION = 1;
+
+  explicit
+  SyncContentEncoder(ContentFormat format);
+
+  ~SyncContentEncoder();
+
+  /**
+   * Add an entry.
+   * @param name The data prefix URI, or empty to leave it out.
+   */
+  void
+  add(const std::string& name, SyncAction action, uint64_t session, uint64_t sequence,
+      const uint8_t* applicationInfo = nullptr, size_t applicationInfoSize = 0);
+
+  /**
+   * Remove the entry added last, for example because it made the content too
+   * big. Only that one entry can be removed.
+   */
+  void
+  removeLast();
+
+  /**
+   * Get the number of entries.
+   */
+  size_t
+  size() const { return size_; }
+
+  bool
+  empty() const { return size_ == 0; }
+
+  ContentFormat
+  getFormat() const { return format_; }
+
+  /**
+   * Get the number of bytes the entries take in the encoded content, which
+   * is what they add to the content of another encoder by append.
+   */
+  size_t
+  getEntriesSize() const { return entriesSize_; }
+
+  /**
+   * Get the size of encode().
+   */
+  size_t
+  getEncodedSize() const;
+
+  /**
+   * Write the entries as the value of a Content element.
+   */
+  ndn::ConstBufferPtr
+  encode() const;
+
+  /**
+   * Append the CONTENT_FORMAT_TLV Entry element of an entry to out.
+   */
+  static void
+  appendTlvEntry(std::string& out, const uint8_t* name, size_t nameSize,
+                 SyncAction action, uint64_t session, uint64_t sequence,
+                 const uint8_t* applicationInfo, size_t applicationInfoSize);
+
+private:
+  SyncContentEncoder(const SyncContentEncoder&) = delete;
+  SyncContentEncoder&
+  operator=(const SyncContentEncoder&) = delete;
+
+  ContentFormat format_;
+  size_t size_;
+  size_t entriesSize_;
+  // what the last entry added to entriesSize_, or 0 if it was removed
+  size_t lastEntrySize_;
+  // the Entry elements, for CONTENT_FORMAT_TLV
+  std::string entries_;
+  // for CONTENT_FORMAT_PROTOBUF
+  std::unique_ptr<Sync::SyncStateMsg> message_;
+};
+
+/**
+ * A SyncContentView decodes the entries of the content of a sync Data while
+ * iterating over them, without copying CONTENT_FORMAT_TLV content or
+ * allocating per entry.
+ */
+class SyncContentView {
+public:
+  /**
+   * An Entry points into the content of its SyncContentView. It is valid
+   * until its iterator is incremented.
+   */
+  class Entry {
+  public:
+    SyncAction
+    getAction() const { return action_; }
+
+    /**
+     * Get the session, an int of ICTVectorState converted to uint64_t. Cast
+     * it back to int.
+     */
+    uint64_t
+    getSession() const { return session_; }
+
+    /**
+     * Get the sequence, at most INT_MAX.
+     */
+    uint64_t
+    getSequence() const { return sequence_; }
+
+    bool
+    hasName() const { return nameSize_ > 0; }
+
+    std::string
+    getName() const { return std::string((const char*)name_, nameSize_); }
+
+    const uint8_t*
+    getApplicationInfo() const { return applicationInfo_; }
+
+    size_t
+    getApplicationInfoSize() const { return applicationInfoSize_; }
+
+  private:
+    friend class SyncContentView;
+
+    SyncAction action_ = SYNC_ACTION_UPDATE;
+    uint64_t session_ = 0;
+    uint64_t sequence_ = 0;
+    const uint8_t* name_ = nullptr;
+    size_t nameSize_ = 0;
+    const uint8_t* applicationInfo_ = nullptr;
+    size_t applicationInfoSize_ = 0;
+  };
+
+  /**
+   * A forward iterator over the entries. It stops at the first malformed
+   * Entry, and skips the entries whose session or sequence does not fit the
+   * int of ICTVectorState. CONTENT_FORMAT_PROTOBUF entries are read from the
+   * parsed message of the view.
+   */
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const Entry value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const Entry* pointer;
+    typedef const Entry& reference;
+
+    const_iterator()
+    : position_(nullptr), end_(nullptr), message_(nullptr), index_(0), isEnd_(true)
+    {
+    }
+
+    const Entry&
+    operator*() const { return entry_; }
+
+    const Entry*
+    operator->() const { return &entry_; }
+
+    const_iterator&
+    operator++()
+    {
+      if (message_ ? !decodeMessageEntry(*message_, index_, entry_) :
+          !decodeEntry(position_, end_, entry_))
+        isEnd_ = true;
+      return *this;
+    }
+
+    const_iterator
+    operator++(int)
+    {
+      const_iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+
+    bool
+    operator==(const const_iterator& other) const
+    {
+      return isEnd_ == other.isEnd_ &&
+        (isEnd_ || (position_ == other.position_ && index_ == other.index_));
+    }
+
+    bool
+    operator!=(const const_iterator& other) const { return !(*this == other); }
+
+  private:
+    friend class SyncContentView;
+
+    const_iterator(const uint8_t* position, const uint8_t* end)
+    : position_(position), end_(end), message_(nullptr), index_(0), isEnd_(false)
+    {
+      ++*this;
+    }
+
+    explicit
+    const_iterator(const Sync::SyncStateMsg* message)
+    : position_(nullptr), end_(nullptr), message_(message), index_(0), isEnd_(false)
+    {
+      ++*this;
+    }
+
+    // the start of the element after entry_
+    const uint8_t* position_;
+    const uint8_t* end_;
+    // for CONTENT_FORMAT_PROTOBUF, the message and the index of the entry
+    // after entry_
+    const Sync::SyncStateMsg* message_;
+    int index_;
+    Entry entry_;
+    // true when there is no entry left to decode
+    bool isEnd_;
+  };
+
+  SyncContentView();
+
+  ~SyncContentView();
+
+  /**
+   * Use the given value of a Content element. CONTENT_FORMAT_TLV content is
+   * not copied, so value must remain valid while the view is used. Gzipped
+   * content is decompressed into storage owned by the view, up to
+   * Gzip::MAX_DECOMPRESSED_SIZE bytes. CONTENT_FORMAT_PROTOBUF content is
+   * parsed into a message owned by the view.
+   * @return false if the content is gzipped but cannot be decompressed or is
+   * too large, is TLV with an unsupported version, or is not a valid
+   * message. The view is then empty.
+   */
+  bool
+  parse(const uint8_t* value, size_t size);
+
+  bool
+  parse(const ndn::ConstBufferPtr& value) { return parse(value->data(), value->size()); }
+
+  const_iterator
+  begin() const
+  {
+    return message_ ? const_iterator(message_.get()) : const_iterator(begin_, end_);
+  }
+
+  const_iterator
+  end() const { return const_iterator(); }
+
+  bool
+  empty() const { return begin() == end(); }
+
+  /**
+   * Get the format the parsed content was written in.
+   */
+  ContentFormat
+  getFormat() const { return format_; }
+
+private:
+  SyncContentView(const SyncContentView&) = delete;
+  SyncContentView&
+  operator=(const SyncContentView&) = delete;
+
+  /**
+   * Use the CONTENT_FORMAT_TLV value from begin to end.
+   */
+  bool
+  parseTlv(const uint8_t* begin, const uint8_t* end);
+
+  /**
+   * Decode the Entry element at position into entry, skipping elements of
+   * other types, and move position past it.
+   * @return false if there is no Entry left or it is malformed.
+   */
+  static bool
+  decodeEntry(const uint8_t*& position, const uint8_t* end, Entry& entry);
+
+  /**
+   * Point entry to the entry at index of message, and move index past it.
+   * @return false if there is no entry left.
+   */
+  static bool
+  decodeMessageEntry(const Sync::SyncStateMsg& message, int& index, Entry& entry);
+
+  const uint8_t* begin_;
+  const uint8_t* end_;
+  ContentFormat format_ = CONTENT_FORMAT_PROTOBUF;
+  // decompressed content which begin_ or message_ was parsed from
+  std::string storage_;
+  // the parsed CONTENT_FORMAT_PROTOBUF content, or null
+  std::unique_ptr<Sync::SyncStateMsg> message_;
+};
+
+}
+
+#endif
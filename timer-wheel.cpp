@@ -0,0 +1,105 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+/*
+ * Copyright (c) 2019-2023 Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "timer-wheel.hpp"
+
+using namespace std;
+
+namespace ict {
+
+TimerWheel::TimerWheel(Clock::duration tick)
+  : start_(Clock::now()), tick_(tick), currentTick_(0), size_(0)
+{
+}
+
+uint64_t
+TimerWheel::toTick(Clock::time_point time) const
+{
+  if (time <= start_)
+    return 0;
+  return (time - start_) / tick_;
+}
+
+void
+TimerWheel::schedule(uint64_t id, Clock::time_point expiry)
+{
+  // round up so that a timer never fires before its expiry
+  uint64_t tick = toTick(expiry);
+  if (start_ + tick * tick_ < expiry)
+    ++tick;
+  if (tick <= currentTick_)
+    tick = currentTick_ + 1;
+
+  insert(Timer{id, tick});
+  ++size_;
+}
+
+void
+TimerWheel::insert(const Timer& timer)
+{
+  for (int level = 0; level < LEVELS; ++level) {
+    int shift = SLOT_BITS * (level + 1);
+    if ((timer.tick >> shift) == (currentTick_ >> shift)) {
+      slots_[level][(timer.tick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(timer);
+      return;
+    }
+  }
+  overflow_.push_back(timer);
+}
+
+void
+TimerWheel::advance(Clock::time_point now, std::vector<uint64_t>& expired)
+{
+  uint64_t nowTick = toTick(now);
+  while (currentTick_ < nowTick) {
+    if (size_ == 0) {
+      // nothing to fire, so skip the empty ticks
+      currentTick_ = nowTick;
+      break;
+    }
+
+    uint64_t tick = ++currentTick_;
+    if ((tick & ((1ULL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+      std::vector<Timer> timers;
+      timers.swap(overflow_);
+      for (const Timer& timer : timers)
+        insert(timer);
+    }
+
+    // When the lower digits of the tick wrap to 0, move the timers of the
+    // next slot of each upper level down. Higher levels go first since their
+    // timers may land in the slot of the level below.
+    for (int level = LEVELS - 1; level >= 1; --level) {
+      if ((tick & ((1ULL << (SLOT_BITS * level)) - 1)) == 0) {
+        std::vector<Timer> timers;
+        timers.swap(slots_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+        for (const Timer& timer : timers)
+          insert(timer);
+      }
+    }
+
+    std::vector<Timer>& slot = slots_[0][tick & (SLOTS - 1)];
+    for (const Timer& timer : slot)
+      expired.push_back(timer.id);
+    size_ -= slot.size();
+    slot.clear();
+  }
+}
+
+}
@@ -0,0 +1,99 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019-2023 Jyoti Parwatikar
+ * and Washington University in St. Louis
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef ICT_TIMER_WHEEL_HPP
+#define ICT_TIMER_WHEEL_HPP
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+namespace ict {
+
+  /**
+   * A TimerWheel keeps timers identified by a caller-chosen id, and returns
+   * the ids whose expiry time has passed. It is a hierarchical wheel of
+   * LEVELS levels of SLOTS slots, so schedule is O(1) and each timer is
+   * moved at most LEVELS times before it fires. Timers cannot be cancelled:
+   * the caller should ignore ids it no longer knows.
+   */
+  class TimerWheel {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Create a TimerWheel.
+     * @param tick The resolution. A timer fires on the first advance at least
+     * one tick after its expiry time.
+     */
+    explicit
+    TimerWheel(Clock::duration tick = std::chrono::milliseconds(1));
+
+    /**
+     * Add a timer which fires at expiry. If expiry has passed, it fires on
+     * the next advance.
+     */
+    void
+    schedule(uint64_t id, Clock::time_point expiry);
+
+    /**
+     * Move the wheel to now, and append the ids of the timers which fired to
+     * expired.
+     */
+    void
+    advance(Clock::time_point now, std::vector<uint64_t>& expired);
+
+    /**
+     * Get the number of timers which have not fired.
+     */
+    size_t
+    size() const { return size_; }
+
+  private:
+    struct Timer {
+      uint64_t id;
+      uint64_t tick;
+    };
+
+    static const int SLOT_BITS = 8;
+    static const size_t SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 4;
+
+    uint64_t
+    toTick(Clock::time_point time) const;
+
+    /**
+     * Put timer in the slot of the lowest level where its tick shares the
+     * upper bits with currentTick_.
+     */
+    void
+    insert(const Timer& timer);
+
+    std::vector<Timer> slots_[LEVELS][SLOTS];
+    // timers more than SLOTS^LEVELS ticks away
+    std::vector<Timer> overflow_;
+    Clock::time_point start_;
+    Clock::duration tick_;
+    // every tick up to this one has been processed
+    uint64_t currentTick_;
+    size_t size_;
+  };
+
+}
+
+#endif //ICT_TIMER_WHEEL_HPP